@@ -0,0 +1,23 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _CRC16_H
+#define _CRC16_H
+
+//i.e. CRC-16/XMODEM: polynomial 0x1021, initial 0, MSB first, no final XOR
+
+typedef uint16_t (crc16_fn)(uint16_t crc, const uint8_t* buf, size_t len);
+
+struct crc16_kernel_t
+{
+	const char* name;
+	crc16_fn* fn;
+	int supported;
+};
+
+uint16_t crc16_update(uint16_t crc, const uint8_t* buf, size_t len);
+const char* crc16_kernel_name(void);
+int crc16_kernels(const struct crc16_kernel_t** kernels, int* cnt);
+int crc16_selfcheck(void);
+
+#endif //_CRC16_H
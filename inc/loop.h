@@ -0,0 +1,24 @@
+#include <stdint.h>
+
+#include "xport.h"
+
+#ifndef _LOOP_H
+#define _LOOP_H
+
+#define LOOP_PREFIX "loop"
+
+struct loop_model_t
+{
+	unsigned long baud;     //i.e. 8N1 bits per second, 0 means unlimited bandwidth
+	unsigned long latency_us;
+	unsigned long jitter_us;
+	double drop_rate;       //i.e. probability of a byte being lost
+	double flip_rate;       //i.e. probability of a byte getting one bit flipped
+	unsigned long seed;
+};
+
+int loop_model_parse(struct loop_model_t* model, const char* spec);
+
+extern const struct xport_ops_t loop_xport_ops;
+
+#endif //_LOOP_H
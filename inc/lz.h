@@ -0,0 +1,31 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _LZ_H
+#define _LZ_H
+
+//i.e. an LZ4-style block codec in a small container: header with the original length, then blocks of up to LZ_BLOCK_SZ bytes
+
+#define LZ_BLOCK_SZ (64 * 1024) //i.e. a match never reaches further back than one block, so offsets fit 16 bits
+#define LZ_HDR_SZ   16          //i.e. magic, version, reserved, original length (big-endian) and CRC-16 of them
+
+typedef int (lz_read_fn)(void* ctx, uint8_t* buf, size_t len);        //i.e. 0 at the end, -1 on error
+typedef int (lz_write_fn)(void* ctx, const uint8_t* buf, size_t len); //i.e. 0 when every byte was taken
+
+struct lz_enc_t;
+struct lz_dec_t;
+
+size_t lz_block_compress(const uint8_t* src, const size_t len, uint8_t* dst, const size_t cap);
+int lz_block_decompress(const uint8_t* src, const size_t len, uint8_t* dst, const size_t cap);
+
+int lz_probe(const uint8_t* data, const size_t len, uint64_t* orig_len);
+
+struct lz_enc_t* lz_enc_open(lz_read_fn* rd, void* ctx, const uint64_t orig_len);
+int lz_enc_read(struct lz_enc_t* enc, uint8_t* buf, const size_t BUF_SZ);
+void lz_enc_close(struct lz_enc_t* enc);
+
+struct lz_dec_t* lz_dec_open(lz_write_fn* wr, void* ctx);
+int lz_dec_write(struct lz_dec_t* dec, const uint8_t* data, const size_t len);
+int lz_dec_close(struct lz_dec_t* dec);
+
+#endif //_LZ_H
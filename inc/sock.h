@@ -0,0 +1,23 @@
+#include <stddef.h>
+
+#include "xport.h"
+
+#ifndef _SOCK_H
+#define _SOCK_H
+
+#define SOCK_TCP_PREFIX  "tcp"  //i.e. "tcp:host:port" or "tcp-listen:[host:]port"
+#define SOCK_UNIX_PREFIX "unix" //i.e. "unix:path" or "unix-listen:path"
+#define SOCK_LISTEN_SUFFIX "-listen"
+#define SOCK_TCP_LISTEN_PREFIX  SOCK_TCP_PREFIX SOCK_LISTEN_SUFFIX
+#define SOCK_UNIX_LISTEN_PREFIX SOCK_UNIX_PREFIX SOCK_LISTEN_SUFFIX
+
+#define SOCK_BUF_SZ 16384 //i.e. a few 1K frames in flight, but no deep queue in front of a slow serial line
+
+extern const struct xport_ops_t sock_tcp_xport_ops;
+extern const struct xport_ops_t sock_tcp_listen_xport_ops;
+#ifndef _WIN32
+extern const struct xport_ops_t sock_unix_xport_ops;
+extern const struct xport_ops_t sock_unix_listen_xport_ops;
+#endif
+
+#endif //_SOCK_H
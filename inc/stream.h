@@ -0,0 +1,32 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef _STREAM_H
+#define _STREAM_H
+
+#define STREAM_CHUNK_SZ  (64 * 1024) //i.e. one read-ahead (or write-behind) buffer
+#define STREAM_CHUNK_CNT 3           //i.e. triple buffering, so memory use does not depend on the file size
+
+struct stream_src_t;
+struct stream_snk_t;
+struct stream_map_t;
+
+//NOTE: verbose is of the caller (e.g. its session), a stream keeps it until it is closed
+struct stream_src_t* stream_src_open(const char* fn, const bool verbose);
+struct stream_src_t* stream_src_open_at(const char* fn, const uint64_t offset, const bool verbose); //i.e. reads from offset on
+int stream_src_read(struct stream_src_t* src, uint8_t* buf, const size_t BUF_SZ);
+void stream_src_close(struct stream_src_t* src);
+
+struct stream_snk_t* stream_snk_open(const char* fn, const bool verbose);
+struct stream_snk_t* stream_snk_open_at(const char* fn, const uint64_t offset, const bool verbose); //i.e. appends to the first offset bytes of an existing file
+struct stream_snk_t* stream_snk_open_in(const char* fn, const uint64_t offset, const bool verbose); //i.e. writes from offset on, with the rest of the file left as it is
+int stream_snk_write(struct stream_snk_t* snk, const uint8_t* buf, const size_t BUF_SZ);
+int stream_snk_close(struct stream_snk_t* snk);
+
+struct stream_map_t* stream_map_open(const char* fn, const bool verbose);
+size_t stream_map_next(struct stream_map_t* map, const uint8_t** data, const size_t BUF_SZ);
+void stream_map_seek(struct stream_map_t* map, const uint64_t offset);
+void stream_map_close(struct stream_map_t* map);
+
+#endif //_STREAM_H
@@ -0,0 +1,18 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "xmodem.h"
+
+#ifndef _STRIPE_H
+#define _STRIPE_H
+
+//i.e. one file over several links at once, each link carries a contiguous segment in its own session on its own thread
+
+#define STRIPE_LINK_MAX 16
+#define STRIPE_ALIGN    1024 //i.e. segments are cut on 1K boundaries, so only the last one ends in a short frame
+
+//NOTE: xs is an array of link_cnt sessions, each on its own open port, which the caller closes afterwards; the first one is verbose for all
+int stripe_transmit(struct xmodem_session_t* xs, const int link_cnt, const char* fn, const bool xmodem_1k);
+int stripe_receive(struct xmodem_session_t* xs, const int link_cnt, const char* dir, struct xmodem_stripe_t* stripe);
+
+#endif //_STRIPE_H
@@ -0,0 +1,24 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <termios.h>
+
+#include "xport.h"
+
+#ifndef _TTY_H
+#define _TTY_H
+
+#define TTY_PTY_PREFIX "pty"
+
+int tty_query(char*** name_list, int* cnt, const bool verbose);
+int tty_open(const char* path, unsigned long baud, const bool verbose);
+int tty_raw(int fd, unsigned long baud, const bool verbose);
+void tty_close(int fd);
+int tty_read(int fd, unsigned char* buf, const size_t BUF_SZ);
+int tty_write(int fd, const unsigned char* buf, const size_t BUF_SZ, const uint64_t timeout_us);
+int tty_writev(int fd, const struct xport_iov_t* iov, const int cnt, const uint64_t timeout_us);
+int tty_wait(int fd, const uint64_t timeout_us);
+
+extern const struct xport_ops_t tty_xport_ops;
+extern const struct xport_ops_t tty_pty_xport_ops;
+
+#endif //_TTY_H
@@ -1,15 +1,103 @@
-#include <windows.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 
+#include "xport.h"
+
 #ifndef _XMODEM_H
 #define _XMODEM_H
 
-void xmodem_verb_clear(void);
-void xmodem_verb_set(void);
-
 typedef int (xmodem_keep_xfer_cb)(void);
 
-int xmodem_transmit(const HANDLE hComm, const short ind_time, const char* fnxmt, const bool xmodem_1k, xmodem_keep_xfer_cb keep_xfer_cb);
-int xmodem_receive(const HANDLE hComm, const short ind_time, const char* fnrcv, xmodem_keep_xfer_cb keep_xfer_cb);
+#define XMODEM_FLAG_MMAP     0x1 //i.e. the transmitter builds frames straight from a mapping of the file
+#define XMODEM_FLAG_STREAM   0x2 //i.e. the receiver asks for streaming with 'G' (YMODEM-G), for error-free links only
+#define XMODEM_FLAG_RESUME   0x4 //i.e. the receiver keeps a checkpoint (fn.ckpt) of a failed transfer and offers to go on from it
+#define XMODEM_FLAG_COMPRESS 0x8 //i.e. the transmitter sends the file compressed, in a container the receiver finds by itself
+
+#define XMODEM_WINDOW_MAX 32 //i.e. frames in flight, far below half of the 8-bit block numbers so a resend is never taken for a new block
+#define XMODEM_WINDOW_DFT 8  //i.e. frames in flight for a transmitter without a size set, when the receiver asks for a window
+
+struct xmodem_rtt_t
+{
+	uint64_t srtt_us;   //i.e. smoothed round-trip time from a frame to its response
+	uint64_t rttvar_us; //i.e. round-trip time variation
+	uint64_t rto_us;    //i.e. current retransmission time-out
+	uint64_t rto_min_us;
+	uint64_t rto_max_us;
+	unsigned long samples;
+};
+
+//i.e. everything a transfer keeps lives in its session or on the stack of the call, so sessions on other threads never meet
+struct xmodem_session_t
+{
+	struct xport_t* xp;
+	short ind_time;
+	xmodem_keep_xfer_cb* keep_xfer_cb;
+	unsigned int flags;
+	unsigned short window; //i.e. frames in flight with a sliding window (the receiver asks with 'W'), 0 for stop-and-wait
+	unsigned int safety_factor; //i.e. time-out as multiples of the frame time at the baud rate, 0 for the default
+	bool verbose;
+	struct xmodem_rtt_t rtt; //NOTE: it is updated live while a transfer runs
+	uint64_t rx_bytes;       //i.e. bytes the receiver stored in its last transfer, a resumed prefix is not counted
+};
+
+void xmodem_session_init(struct xmodem_session_t* xs, struct xport_t* xp, const short ind_time, xmodem_keep_xfer_cb keep_xfer_cb);
+void xmodem_session_rtt(const struct xmodem_session_t* xs, struct xmodem_rtt_t* rtt);
+
+int xmodem_transmit(struct xmodem_session_t* xs, const char* fnxmt, const bool xmodem_1k);
+int xmodem_receive(struct xmodem_session_t* xs, const char* fnrcv);
+
+//i.e. YMODEM batch, block 0 carries the name, length and modification time of each file, the receiver stores them in dir
+int xmodem_transmit_batch(struct xmodem_session_t* xs, const char* const* fns, const int cnt, const bool xmodem_1k);
+int xmodem_receive_batch(struct xmodem_session_t* xs, const char* dir);
+
+//i.e. striping, a contiguous segment of a file goes as a batch of one, and block 0 also names its place in the whole file
+struct xmodem_stripe_t
+{
+	unsigned short idx; //i.e. of the segment, from 0
+	unsigned short cnt; //i.e. segments of the file, 0 when the file was sent whole
+	uint64_t offset;    //i.e. where the segment starts in the file
+	uint64_t len;
+	uint64_t size;      //i.e. of the whole file
+	char path[260];     //i.e. filled in by the receiver, the file the segment was written into
+};
+
+int xmodem_transmit_stripe(struct xmodem_session_t* xs, const char* fn, const struct xmodem_stripe_t* stripe, const bool xmodem_1k);
+int xmodem_receive_stripe(struct xmodem_session_t* xs, const char* dir, struct xmodem_stripe_t* stripe);
+
+//i.e. in-process transfers, a single file comes from the caller and goes to the caller without touching the disk
+typedef int (xmodem_read_cb)(void* ctx, uint8_t* buf, size_t len);        //i.e. bytes read, 0 at the end, -1 on error
+typedef int (xmodem_write_cb)(void* ctx, const uint8_t* buf, size_t len); //i.e. 0 when every byte was taken, -1 otherwise
+
+struct xmodem_source_t
+{
+	const uint8_t* data; //i.e. a buffer of the caller, frames are built straight from it, may be NULL when size is 0
+	xmodem_read_cb* read; //i.e. called instead when set
+	void* ctx;
+	uint64_t size;       //i.e. of data, or of what read gives, compression needs it up front
+};
+
+struct xmodem_sink_t
+{
+	xmodem_write_cb* write; //i.e. called with each accepted block in place in the frame
+	void* ctx;
+};
+
+struct xmodem_buf_t
+{
+	uint8_t* data;
+	size_t len;       //i.e. bytes received so far
+	size_t cap;
+	bool is_growable; //i.e. data is reallocated as it fills and the caller frees it, else a transfer which overflows it fails
+};
+
+void xmodem_source_buf(struct xmodem_source_t* src, const uint8_t* data, const size_t len);
+void xmodem_sink_buf(struct xmodem_sink_t* snk, struct xmodem_buf_t* buf);
+
+//NOTE: as with a file, plain XMODEM leaves the padding of the last block, unless the container of compression ends it
+//NOTE: a fixed buffer sized to the payload still takes it, the padding which does not fit is dropped and len stays at cap
+//NOTE: a buffer source can resume, a read callback is sent from the start, and a sink never keeps a checkpoint
+int xmodem_transmit_source(struct xmodem_session_t* xs, const struct xmodem_source_t* src, const bool xmodem_1k);
+int xmodem_receive_sink(struct xmodem_session_t* xs, const struct xmodem_sink_t* snk);
 
 #endif //_XMODEM_H
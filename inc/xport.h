@@ -0,0 +1,67 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef _XPORT_H
+#define _XPORT_H
+
+//NOTE: capabilities reported by a transport backend
+#define XPORT_CAP_BAUD      0x0001 //i.e. baud rate is meaningful (a real UART)
+#define XPORT_CAP_WAIT      0x0002 //i.e. wait() blocks until data arrives rather than sleeping
+#define XPORT_CAP_RELIABLE  0x0004 //i.e. link is error-corrected (socket, pipe, in-memory)
+
+#define XPORT_RX_BUF_SZ     8192 //NOTE: larger than the largest frame, so a whole frame is drained at once
+#define XPORT_TX_TIMEOUT    6000 //i.e. in ms, the default of tx_timeout_us
+
+struct xport_t;
+
+typedef int (xport_keep_cb)(void); //i.e. 0 stops a wait of the backend, such as a listener waiting for its peer
+
+struct xport_iov_t
+{
+	const unsigned char* buf;
+	size_t len;
+};
+
+struct xport_ops_t
+{
+	const char* name;
+	const char* prefix; //NOTE: NULL means the native serial port backend
+	int (*open)(struct xport_t* xp, const char* name, unsigned long baud);
+	int (*read)(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ);
+	int (*write)(struct xport_t* xp, const unsigned char* buf, const size_t BUF_SZ);
+	int (*writev)(struct xport_t* xp, const struct xport_iov_t* iov, const int cnt); //NOTE: optional, NULL means one write per piece
+	int (*wait)(struct xport_t* xp, const uint64_t timeout_us);
+	void (*close)(struct xport_t* xp);
+};
+
+struct xport_t
+{
+	const struct xport_ops_t* ops;
+	unsigned int caps;
+	unsigned long baud;
+	void* priv;
+	bool verbose;
+	uint64_t tx_timeout_us; //i.e. longest a write waits for room on a full link before it fails
+	uint64_t open_timeout_us; //i.e. longest the open waits for a peer, 0 for as long as keep_cb allows
+	xport_keep_cb* keep_cb;
+	unsigned char* rx_buf;
+	size_t rx_head;
+	size_t rx_tail;
+	unsigned long long rx_calls;
+	unsigned long long rx_bytes;
+};
+
+bool xport_name_is(const char* name, const char* prefix); //i.e. name is prefix alone or prefix followed by ':'
+int xport_query(char*** name_list, int* cnt, const bool verbose);
+void xport_query_release(char** name_list, int cnt);
+struct xport_t* xport_open(const char* name, unsigned long baud, const bool verbose, const uint64_t open_timeout_us, xport_keep_cb* keep_cb); //NOTE: verbose is of the port, its backend logs with it
+void xport_close(struct xport_t* xp);
+int xport_read(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ);
+int xport_write(struct xport_t* xp, const unsigned char* buf, const size_t BUF_SZ);
+int xport_writev(struct xport_t* xp, const struct xport_iov_t* iov, const int cnt);
+int xport_wait(struct xport_t* xp, const uint64_t deadline_us);
+unsigned int xport_caps(const struct xport_t* xp);
+uint64_t xport_now_us(void);
+
+#endif //_XPORT_H
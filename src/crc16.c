@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CRC16_HAS_CLMUL
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "crc16.h"
+
+#define CRC16_POLY 0x1021
+#define CRC16_CLMUL_MIN 64 //i.e. below four lanes of 16 bytes the table is faster anyway
+
+static uint16_t crc16_table[8][256]; //i.e. crc16_table[k][b] is the CRC of byte b followed by k zero bytes
+
+static uint16_t crc16_bitwise(uint16_t crc, const uint8_t* buf, size_t len)
+{
+	//i.e. the reference, which is the textbook loop used since the first release
+	while(len-- > 0)
+	{
+		crc = crc ^ (uint16_t)(*buf++) << 8;
+		int i = 8;
+		do
+		{
+			if(crc & 0x8000)
+				crc = crc << 1 ^ CRC16_POLY;
+			else
+				crc = crc << 1;
+		} while(--i);
+	}
+	return crc;
+}
+
+static void crc16_table_init(void)
+{
+	int b = 0;
+	for(b = 0; b < 256; b++)
+	{
+		uint8_t byte = (uint8_t)b;
+		crc16_table[0][b] = crc16_bitwise(0, &byte, 1);
+	}
+	int k = 0;
+	for(k = 1; k < 8; k++)
+	{
+		for(b = 0; b < 256; b++)
+		{
+			uint16_t prev = crc16_table[k-1][b];
+			crc16_table[k][b] = (uint16_t)(prev << 8) ^ crc16_table[0][prev >> 8];
+		}
+	}
+}
+
+static uint16_t crc16_slice8(uint16_t crc, const uint8_t* buf, size_t len)
+{
+	while(len >= 8)
+	{
+		crc = crc16_table[7][buf[0] ^ (crc >> 8)] ^
+			crc16_table[6][buf[1] ^ (crc & 0xff)] ^
+			crc16_table[5][buf[2]] ^
+			crc16_table[4][buf[3]] ^
+			crc16_table[3][buf[4]] ^
+			crc16_table[2][buf[5]] ^
+			crc16_table[1][buf[6]] ^
+			crc16_table[0][buf[7]];
+		buf += 8;
+		len -= 8;
+	}
+	while(len-- > 0)
+	{
+		crc = (uint16_t)(crc << 8) ^ crc16_table[0][(crc >> 8) ^ *buf++];
+	}
+	return crc;
+}
+
+#ifdef CRC16_HAS_CLMUL
+static uint64_t crc16_xpow_mod(unsigned int n)
+{
+	//i.e. x^n mod P, it is a folding constant of degree < 16
+	uint32_t r = 1;
+	while(n-- > 0)
+	{
+		r <<= 1;
+		if(r & 0x10000)
+		{
+			r ^= 0x10000 | CRC16_POLY;
+		}
+	}
+	return r;
+}
+
+static __m128i crc16_fold_k[2]; //i.e. {x^(512+64), x^512} for the lanes, {x^(128+64), x^128} to merge them
+
+__attribute__((target("pclmul,ssse3")))
+static inline __m128i crc16_fold(__m128i x, __m128i k, __m128i next)
+{
+	//i.e. x * x^(distance) mod P with x split into its high and low 64-bit halves
+	__m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+	__m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+	return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+__attribute__((target("pclmul,ssse3")))
+static uint16_t crc16_clmul(uint16_t crc, const uint8_t* buf, size_t len)
+{
+	//i.e. a 16-byte block is a 128-bit polynomial once it is byte-swapped, and blocks are folded
+	//forward by multiplying with x^n mod P; the remainder has the same CRC as the folded prefix
+	if(len < CRC16_CLMUL_MIN)
+	{
+		return crc16_slice8(crc, buf, len);
+	}
+	const __m128i bswap = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	__m128i x[4];
+	int k = 0;
+	for(k = 0; k < 4; k++)
+	{
+		x[k] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf + k * 16)), bswap);
+	}
+	//i.e. the running CRC is the same as an XOR into the first 16 bits of the message
+	x[0] = _mm_xor_si128(x[0], _mm_insert_epi16(_mm_setzero_si128(), crc, 7));
+	buf += 64;
+	len -= 64;
+	while(len >= 64)
+	{
+		for(k = 0; k < 4; k++)
+		{
+			__m128i next = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(buf + k * 16)), bswap);
+			x[k] = crc16_fold(x[k], crc16_fold_k[0], next);
+		}
+		buf += 64;
+		len -= 64;
+	}
+	__m128i r = crc16_fold(x[0], crc16_fold_k[1], x[1]);
+	r = crc16_fold(r, crc16_fold_k[1], x[2]);
+	r = crc16_fold(r, crc16_fold_k[1], x[3]);
+	uint8_t rem[16];
+	_mm_storeu_si128((__m128i*)rem, _mm_shuffle_epi8(r, bswap));
+	crc = crc16_slice8(0, rem, sizeof(rem));
+	return crc16_slice8(crc, buf, len);
+}
+
+static int crc16_clmul_supported(void)
+{
+	unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+	if(__get_cpuid(1, &eax, &ebx, &ecx, &edx) == 0)
+	{
+		return 0;
+	}
+	return ((ecx & bit_PCLMUL) != 0 && (ecx & bit_SSSE3) != 0)?(1):(0);
+}
+
+static void crc16_clmul_init(void)
+{
+	crc16_fold_k[0] = _mm_set_epi64x((long long)crc16_xpow_mod(512 + 64), (long long)crc16_xpow_mod(512));
+	crc16_fold_k[1] = _mm_set_epi64x((long long)crc16_xpow_mod(128 + 64), (long long)crc16_xpow_mod(128));
+}
+#endif
+
+static struct crc16_kernel_t crc16_kernel_list[] =
+{
+	{"bitwise", crc16_bitwise, 1},
+	{"slice8", crc16_slice8, 1},
+#ifdef CRC16_HAS_CLMUL
+	{"clmul", crc16_clmul, 0},
+#endif
+};
+
+#define CRC16_KERNEL_CNT ((int)(sizeof(crc16_kernel_list)/sizeof(crc16_kernel_list[0])))
+
+static pthread_once_t crc16_once = PTHREAD_ONCE_INIT;
+static const struct crc16_kernel_t* crc16_kernel = &crc16_kernel_list[1];
+
+static void crc16_init(void)
+{
+	crc16_table_init();
+#ifdef CRC16_HAS_CLMUL
+	if(crc16_clmul_supported())
+	{
+		crc16_clmul_init();
+		crc16_kernel_list[2].supported = 1;
+	}
+#endif
+	//i.e. the last supported one is the fastest, but only if it agrees with the reference on a known message
+	static const uint8_t check[] = "123456789123456789123456789123456789123456789123456789123456789123456789";
+	const uint16_t expected = crc16_bitwise(0, check, sizeof(check) - 1);
+	int k = 0;
+	for(k = CRC16_KERNEL_CNT - 1; k > 0; k--)
+	{
+		if(crc16_kernel_list[k].supported && crc16_kernel_list[k].fn(0, check, sizeof(check) - 1) == expected)
+		{
+			break;
+		}
+	}
+	crc16_kernel = &crc16_kernel_list[k];
+}
+
+uint16_t crc16_update(uint16_t crc, const uint8_t* buf, size_t len)
+{
+	(void)pthread_once(&crc16_once, crc16_init);
+	return crc16_kernel->fn(crc, buf, len);
+}
+
+const char* crc16_kernel_name(void)
+{
+	(void)pthread_once(&crc16_once, crc16_init);
+	return crc16_kernel->name;
+}
+
+int crc16_kernels(const struct crc16_kernel_t** kernels, int* cnt)
+{
+	if(kernels == NULL || cnt == NULL)
+	{
+		return -1;
+	}
+	(void)pthread_once(&crc16_once, crc16_init);
+	*kernels = crc16_kernel_list;
+	*cnt = CRC16_KERNEL_CNT;
+	return 0;
+}
+
+int crc16_selfcheck(void)
+{
+	//i.e. every supported kernel must match the bitwise reference for each length, alignment and running CRC
+	const size_t BUF_SZ = 2 * 1024 + 64;
+	uint8_t* buf = (uint8_t*)malloc(BUF_SZ);
+	if(buf == NULL)
+	{
+		return -1;
+	}
+	(void)pthread_once(&crc16_once, crc16_init);
+	uint32_t seed = 0x12345678;
+	size_t i = 0;
+	for(i = 0; i < BUF_SZ; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		buf[i] = (uint8_t)(seed >> 16);
+	}
+	int mismatch = 0;
+	size_t len = 0;
+	for(len = 0; len <= 2 * 1024 + 32; len++)
+	{
+		size_t align = len % 16;
+		uint16_t init = (uint16_t)(len * 0x9E37);
+		uint16_t expected = crc16_bitwise(init, buf + align, len);
+		int k = 0;
+		for(k = 1; k < CRC16_KERNEL_CNT; k++)
+		{
+			if(crc16_kernel_list[k].supported && crc16_kernel_list[k].fn(init, buf + align, len) != expected)
+			{
+				printf("[%s] %s, len = %u, align = %u, init = 0x%04x\n", __FUNCTION__, crc16_kernel_list[k].name, (unsigned int)len, (unsigned int)align, init);
+				mismatch++;
+			}
+		}
+	}
+	free(buf);
+	return (mismatch == 0)?(0):(-1);
+}
@@ -3,10 +3,20 @@
 #include <string.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <signal.h>
+#endif
 
-#include "sp.h"
+#include "xport.h"
+#include "crc16.h"
+#include "stream.h"
+#include "loop.h"
 #include "xmodem.h"
+#include "stripe.h"
 
 #define	LOG_LEVEL_ERR  0
 #define	LOG_LEVEL_WARN 1
@@ -29,12 +39,13 @@ static int log_level = LOG_LEVEL_ERR;
 #define log_dbg(fmt, ...) \
 	do { if(log_level >= LOG_LEVEL_DBG) printf(fmt, __VA_ARGS__); } while(0)
 
-static bool keep = true;
+static volatile bool keep = true;
 static int is_xfer_keep(void)
 {
 	return (keep == true)?1:0;
 }
 
+#ifdef _WIN32
 static BOOL WINAPI console_handler(DWORD dwType)
 {
 	switch(dwType)
@@ -60,22 +71,538 @@ static BOOL WINAPI console_handler(DWORD dwType)
 
 	return TRUE;
 }
+#else
+static void console_handler(int signo)
+{
+	//NOTE: printf is not async-signal-safe, so nothing is logged here
+	(void)signo;
+	keep = false;
+}
+#endif
+
+static void port_name_set(char* port_name, const size_t PORT_NAME_SZ, const char* arg)
+{
+	//i.e. a bare number is the serial port of that number
+	char* end = NULL;
+	unsigned long port_number = strtoul(arg, &end, 0);
+	memset(port_name, '\0', PORT_NAME_SZ);
+	if(end != arg && *end == '\0')
+	{
+#ifdef _WIN32
+		snprintf(port_name, PORT_NAME_SZ, "COM%lu", port_number);
+#else
+		snprintf(port_name, PORT_NAME_SZ, "/dev/ttyS%lu", port_number);
+#endif
+	}
+	else
+	{
+		strncpy(port_name, arg, PORT_NAME_SZ-sizeof(char));
+	}
+}
+
+struct loopback_rcv_t
+{
+	struct xmodem_session_t xs;
+	const char* fn;
+	bool is_batch;
+	int xret;
+};
+
+static void* loopback_rcv_thread(void* arg)
+{
+	struct loopback_rcv_t* rcv = (struct loopback_rcv_t*)arg;
+	rcv->xret = (rcv->is_batch == true)?(xmodem_receive_batch(&rcv->xs, rcv->fn)):(xmodem_receive(&rcv->xs, rcv->fn));
+	//i.e. the end goes away with the receiver, as with a peer process, so a streaming transmitter is not left blocked on a full link
+	xport_close(rcv->xs.xp);
+	rcv->xs.xp = NULL;
+	return NULL;
+}
+
+static int loopback_xfer(const char* port_name, unsigned long baud, const struct xmodem_session_t* proto, const char* const* fns, int fn_cnt, const char* fnrcv, bool is_batch, bool is_xmodem_1k)
+{
+	//i.e. both ends run in this process, joined by the in-memory link, each in a session copied from proto
+	int xret = -1;
+	struct xport_t* xpa = xport_open(port_name, baud, proto->verbose, (uint64_t)proto->ind_time * 1000000ULL, proto->keep_xfer_cb);
+	struct xport_t* xpb = xport_open(port_name, baud, proto->verbose, (uint64_t)proto->ind_time * 1000000ULL, proto->keep_xfer_cb);
+	do
+	{
+		if(xpa == NULL || xpb == NULL)
+		{
+			log_err("fail to open port (%s)!\n", port_name);
+			break;
+		}
+		struct loopback_rcv_t rcv;
+		rcv.xs = *proto;
+		rcv.xs.xp = xpb;
+		rcv.fn = fnrcv;
+		rcv.is_batch = is_batch;
+		rcv.xret = -1;
+		pthread_t tid;
+		uint64_t tsBegin = xport_now_us();
+		if(pthread_create(&tid, NULL, loopback_rcv_thread, &rcv) != 0)
+		{
+			log_err("fail to create thread (%s)!\n", port_name);
+			break;
+		}
+		xpb = NULL; //i.e. it is closed by the receiver thread
+		struct xmodem_session_t xs = *proto;
+		xs.xp = xpa;
+		xret = (is_batch == true)?(xmodem_transmit_batch(&xs, fns, fn_cnt, is_xmodem_1k)):(xmodem_transmit(&xs, fns[0], is_xmodem_1k));
+		pthread_join(tid, NULL);
+		uint64_t elapsed = xport_now_us() - tsBegin;
+		if(rcv.xret != 0)
+		{
+			xret = rcv.xret;
+		}
+		//i.e. what the receiver stored in this run, neither a failed run nor a resumed prefix counts the file as sent
+		long long size = (long long)rcv.xs.rx_bytes;
+		printf("loopback: xret = %d, size = %lld bytes, elapsed = %llu us", xret, size, (unsigned long long)elapsed);
+		double goodput = (elapsed > 0)?((double)size * 1000000.0 / (double)elapsed):(0);
+		if(xret == 0)
+		{
+			printf(", goodput = %.1f B/s", goodput);
+		}
+		if(xret == 0 && xpa->baud != 0)
+		{
+			double raw = (double)xpa->baud / 10.0;
+			printf(", raw = %.1f B/s, efficiency = %.3f", raw, goodput / raw);
+		}
+		printf("\n");
+	} while(0);
+	xport_close(xpa);
+	xport_close(xpb);
+	return xret;
+}
+
+struct stripe_rcv_t
+{
+	struct xmodem_session_t* xs;
+	int link_cnt;
+	const char* dir;
+	struct xmodem_stripe_t stripe;
+	int xret;
+};
+
+static void* stripe_rcv_thread(void* arg)
+{
+	struct stripe_rcv_t* rcv = (struct stripe_rcv_t*)arg;
+	rcv->xret = stripe_receive(rcv->xs, rcv->link_cnt, rcv->dir, &rcv->stripe);
+	return NULL;
+}
+
+static int stripe_xfer(const char* const* names, int link_cnt, unsigned long baud, const struct xmodem_session_t* proto, const char* fn, const char* dir_loop, bool is_receiver, bool is_xmodem_1k)
+{
+	//i.e. one session per link, with dir_loop both ends run in this process over pairs of in-memory links
+	int xret = -1;
+	struct xport_t* xpa[STRIPE_LINK_MAX] = {NULL};
+	struct xport_t* xpb[STRIPE_LINK_MAX] = {NULL};
+	struct xmodem_session_t xsa[STRIPE_LINK_MAX];
+	struct xmodem_session_t xsb[STRIPE_LINK_MAX];
+	int k = 0;
+	do
+	{
+		for(k = 0; k < link_cnt; k++)
+		{
+			//NOTE: in-memory links pair up in the order they are opened, so both ends of one are opened together
+			xpa[k] = xport_open(names[k], baud, proto->verbose, (uint64_t)proto->ind_time * 1000000ULL, proto->keep_xfer_cb);
+			xpb[k] = (dir_loop != NULL)?(xport_open(names[k], baud, proto->verbose, (uint64_t)proto->ind_time * 1000000ULL, proto->keep_xfer_cb)):(NULL);
+			if(xpa[k] == NULL || (dir_loop != NULL && xpb[k] == NULL))
+			{
+				log_err("fail to open port (%s)!\n", names[k]);
+				break;
+			}
+			xsa[k] = *proto;
+			xsa[k].xp = xpa[k];
+			xsb[k] = *proto;
+			xsb[k].xp = xpb[k];
+		}
+		if(k < link_cnt)
+		{
+			break;
+		}
+		uint64_t size = 0; //i.e. bytes the receivers stored
+		uint64_t tsBegin = xport_now_us();
+		if(dir_loop != NULL)
+		{
+			struct stripe_rcv_t rcv = {.xs = xsb, .link_cnt = link_cnt, .dir = (strlen(dir_loop) > 0)?(dir_loop):("."), .xret = -1};
+			pthread_t tid;
+			if(pthread_create(&tid, NULL, stripe_rcv_thread, &rcv) != 0)
+			{
+				log_err("fail to create thread (%s)!\n", names[0]);
+				break;
+			}
+			xret = stripe_transmit(xsa, link_cnt, fn, is_xmodem_1k);
+			pthread_join(tid, NULL);
+			if(rcv.xret != 0)
+			{
+				xret = rcv.xret;
+			}
+			for(k = 0; k < link_cnt; k++)
+			{
+				size += xsb[k].rx_bytes;
+			}
+		}
+		else if(is_receiver == true)
+		{
+			struct xmodem_stripe_t stripe;
+			xret = stripe_receive(xsa, link_cnt, (strlen(fn) > 0)?(fn):("."), &stripe);
+			for(k = 0; k < link_cnt; k++)
+			{
+				size += xsa[k].rx_bytes;
+			}
+		}
+		else
+		{
+			//NOTE: the receiver is elsewhere, so the file counts only once every segment was taken
+			struct stat st;
+			memset(&st, 0, sizeof(st));
+			xret = stripe_transmit(xsa, link_cnt, fn, is_xmodem_1k);
+			size = (xret == 0 && stat(fn, &st) == 0)?((uint64_t)st.st_size):(0);
+		}
+		uint64_t elapsed = xport_now_us() - tsBegin;
+		printf("stripe: xret = %d, links = %d, size = %llu bytes, elapsed = %llu us", xret, link_cnt, (unsigned long long)size, (unsigned long long)elapsed);
+		double goodput = (elapsed > 0)?((double)size * 1000000.0 / (double)elapsed):(0);
+		if(xret == 0)
+		{
+			printf(", goodput = %.1f B/s", goodput);
+		}
+		if(xret == 0 && xpa[0]->baud != 0)
+		{
+			double raw = (double)xpa[0]->baud / 10.0 * (double)link_cnt;
+			printf(", raw = %.1f B/s, efficiency = %.3f", raw, goodput / raw);
+		}
+		printf("\n");
+	} while(0);
+	for(k = 0; k < link_cnt; k++)
+	{
+		xport_close(xpa[k]);
+		xport_close(xpb[k]);
+	}
+	return xret;
+}
+
+static int crc16_check(void)
+{
+	//i.e. bit-exactness against the bitwise reference, then the throughput of each kernel on 1K frames
+	int cret = crc16_selfcheck();
+	printf("crc16: self-check = %s, selected = %s\n", (cret == 0)?("pass"):("FAIL"), crc16_kernel_name());
+	const struct crc16_kernel_t* kernels = NULL;
+	int cnt = 0;
+	(void)crc16_kernels(&kernels, &cnt);
+	uint8_t frame[1024];
+	size_t i = 0;
+	for(i = 0; i < sizeof(frame); i++)
+	{
+		frame[i] = (uint8_t)(i * 131 + 7);
+	}
+	int k = 0;
+	for(k = 0; k < cnt; k++)
+	{
+		if(!kernels[k].supported)
+		{
+			printf("crc16: %-8s unsupported\n", kernels[k].name);
+			continue;
+		}
+		const int FRAME_CNT = 64 * 1024;
+		uint16_t crc = 0;
+		uint64_t tsBegin = xport_now_us();
+		int n = 0;
+		for(n = 0; n < FRAME_CNT; n++)
+		{
+			crc = kernels[k].fn(crc, frame, sizeof(frame));
+		}
+		uint64_t elapsed = xport_now_us() - tsBegin;
+		printf("crc16: %-8s %8.1f MB/s (0x%04x)\n", kernels[k].name, (elapsed > 0)?((double)FRAME_CNT * sizeof(frame) / (double)elapsed):(0), crc);
+	}
+	return cret;
+}
+
+struct mem_cb_t
+{
+	const uint8_t* data; //i.e. what is read, or what is expected to be written
+	size_t size;
+	size_t pos;
+	bool is_same;
+};
+
+static int mem_cb_read(void* ctx, uint8_t* buf, size_t len)
+{
+	//i.e. short reads on purpose, the transmitter has to fill its blocks across calls
+	struct mem_cb_t* cb = (struct mem_cb_t*)ctx;
+	size_t cnt = cb->size - cb->pos;
+	cnt = (cnt < len)?(cnt):(len);
+	cnt = (cnt < 100)?(cnt):(100);
+	if(cnt > 0)
+	{
+		memcpy(buf, &cb->data[cb->pos], cnt);
+	}
+	cb->pos += cnt;
+	return (int)cnt;
+}
+
+static int mem_cb_write(void* ctx, const uint8_t* buf, size_t len)
+{
+	//i.e. what goes past size is the padding of the last block
+	struct mem_cb_t* cb = (struct mem_cb_t*)ctx;
+	size_t cnt = (cb->pos < cb->size)?(cb->size - cb->pos):(0);
+	cnt = (cnt < len)?(cnt):(len);
+	if(cnt > 0 && memcmp(&cb->data[cb->pos], buf, cnt) != 0)
+	{
+		cb->is_same = false;
+	}
+	cb->pos += len;
+	return 0;
+}
+
+struct mem_rcv_t
+{
+	struct xmodem_session_t xs;
+	const struct xmodem_sink_t* snk;
+	int xret;
+};
+
+static void* mem_rcv_thread(void* arg)
+{
+	struct mem_rcv_t* rcv = (struct mem_rcv_t*)arg;
+	rcv->xret = xmodem_receive_sink(&rcv->xs, rcv->snk);
+	xport_close(rcv->xs.xp);
+	rcv->xs.xp = NULL;
+	return NULL;
+}
+
+static int mem_xfer(const char* port_name, const struct xmodem_session_t* proto, const struct xmodem_source_t* src, const struct xmodem_sink_t* snk, bool is_xmodem_1k)
+{
+	//i.e. as loopback_xfer, with the source and the sink of the caller instead of files
+	int xret = -1;
+	struct xport_t* xpa = xport_open(port_name, 0, proto->verbose, (uint64_t)proto->ind_time * 1000000ULL, proto->keep_xfer_cb);
+	struct xport_t* xpb = xport_open(port_name, 0, proto->verbose, (uint64_t)proto->ind_time * 1000000ULL, proto->keep_xfer_cb);
+	do
+	{
+		if(xpa == NULL || xpb == NULL)
+		{
+			log_err("fail to open port (%s)!\n", port_name);
+			break;
+		}
+		struct mem_rcv_t rcv;
+		rcv.xs = *proto;
+		rcv.xs.xp = xpb;
+		rcv.snk = snk;
+		rcv.xret = -1;
+		pthread_t tid;
+		if(pthread_create(&tid, NULL, mem_rcv_thread, &rcv) != 0)
+		{
+			log_err("fail to create thread (%s)!\n", port_name);
+			break;
+		}
+		xpb = NULL; //i.e. it is closed by the receiver thread
+		struct xmodem_session_t xs = *proto;
+		xs.xp = xpa;
+		xret = xmodem_transmit_source(&xs, src, is_xmodem_1k);
+		pthread_join(tid, NULL);
+		if(rcv.xret != 0)
+		{
+			xret = rcv.xret;
+		}
+	} while(0);
+	xport_close(xpa);
+	xport_close(xpb);
+	return xret;
+}
+
+static int mem_check(const char* port_name, const struct xmodem_session_t* proto)
+{
+	//i.e. each source of the caller against each sink, with the padding of plain XMODEM and the exact length of compression
+	const size_t SIZE = 100000 + 37; //i.e. not a multiple of any block
+	uint8_t* data = (uint8_t*)malloc(SIZE);
+	if(data == NULL)
+	{
+		return -1;
+	}
+	size_t i = 0;
+	for(i = 0; i < SIZE; i++)
+	{
+		data[i] = (i % 4096 < 2048)?((uint8_t)(i / 64)):((uint8_t)(i * 2654435761u >> 13)); //i.e. half runs, half noise, for compression
+	}
+	int fail_cnt = 0;
+	int k = 0;
+	for(k = 0; k < 8; k++)
+	{
+		struct xmodem_session_t xs = *proto;
+		const bool is_xmodem_1k = (k % 2 == 1)?(true):(false);
+		const bool is_cb = (k >= 4)?(true):(false);
+		xs.flags = (k % 4 >= 2)?(XMODEM_FLAG_COMPRESS):(0);
+		xs.window = (k == 3 || k == 5)?(8):(0);
+		struct xmodem_source_t src;
+		struct xmodem_sink_t snk;
+		struct mem_cb_t rd = {data, SIZE, 0, true};
+		struct mem_cb_t wr = {data, SIZE, 0, true};
+		struct xmodem_buf_t buf = {NULL, 0, 0, false};
+		xmodem_source_buf(&src, data, SIZE);
+		if(is_cb == true)
+		{
+			src.data = NULL;
+			src.read = mem_cb_read;
+			src.ctx = &rd;
+			snk.write = mem_cb_write;
+			snk.ctx = &wr;
+		}
+		else
+		{
+			//i.e. a fixed buffer sized to the payload, then a growable one
+			buf.data = (k % 2 == 0)?((uint8_t*)malloc(SIZE)):(NULL);
+			buf.cap = (buf.data != NULL)?(SIZE):(0);
+			buf.is_growable = (buf.data == NULL)?(true):(false);
+			xmodem_sink_buf(&snk, &buf);
+		}
+		int xret = mem_xfer(port_name, &xs, &src, &snk, is_xmodem_1k);
+		const size_t len = (is_cb == true)?(wr.pos):(buf.len);
+		const bool is_same = (is_cb == true)?(wr.is_same):(buf.len >= SIZE && memcmp(buf.data, data, SIZE) == 0);
+		const bool is_pass = (xret == 0 && is_same == true && (len == SIZE || (xs.flags & XMODEM_FLAG_COMPRESS) == 0))?(true):(false);
+		printf("mem: %-8s -> %-8s %s%s window = %-2hu len = %-7zu %s\n", (is_cb == true)?("read"):("buffer"), (is_cb == true)?("write"):((buf.is_growable == true)?("growable"):("fixed")),
+			(is_xmodem_1k == true)?("1k"):("128"), ((xs.flags & XMODEM_FLAG_COMPRESS) != 0)?(" lz"):("   "), xs.window, len, (is_pass == true)?("pass"):("FAIL"));
+		fail_cnt += (is_pass == true)?(0):(1);
+		free(buf.data);
+	}
+	//i.e. an empty buffer may be NULL
+	{
+		struct xmodem_source_t src;
+		struct xmodem_sink_t snk;
+		struct xmodem_buf_t buf = {NULL, 0, 0, true};
+		xmodem_source_buf(&src, NULL, 0);
+		xmodem_sink_buf(&snk, &buf);
+		int xret = mem_xfer(port_name, proto, &src, &snk, false);
+		const bool is_pass = (xret == 0)?(true):(false);
+		printf("mem: %-8s -> %-8s len = %-7zu %s\n", "empty", "growable", buf.len, (is_pass == true)?("pass"):("FAIL"));
+		fail_cnt += (is_pass == true)?(0):(1);
+		free(buf.data);
+	}
+	//i.e. a fixed buffer one byte short of the payload fails
+	{
+		struct xmodem_source_t src;
+		struct xmodem_sink_t snk;
+		struct xmodem_buf_t buf = {(uint8_t*)malloc(SIZE - 1), 0, SIZE - 1, false};
+		xmodem_source_buf(&src, data, SIZE);
+		xmodem_sink_buf(&snk, &buf);
+		int xret = (buf.data != NULL)?(mem_xfer(port_name, proto, &src, &snk, true)):(0);
+		const bool is_pass = (xret != 0)?(true):(false);
+		printf("mem: %-8s -> %-8s len = %-7zu %s\n", "buffer", "short", buf.len, (is_pass == true)?("pass"):("FAIL"));
+		fail_cnt += (is_pass == true)?(0):(1);
+		free(buf.data);
+	}
+	free(data);
+	return (fail_cnt == 0)?(0):(-1);
+}
+
+#ifndef _WIN32
+static bool file_is_intact(const char* path, const char* text)
+{
+	char buf[64] = {'\0'};
+	FILE* fp = fopen(path, "rb");
+	if(fp == NULL)
+	{
+		return false;
+	}
+	size_t len = fread(buf, sizeof(char), sizeof(buf) - sizeof(char), fp);
+	fclose(fp);
+	return (len == strlen(text) && memcmp(buf, text, len) == 0)?(true):(false);
+}
+#endif
+
+static int xport_check(const struct xmodem_session_t* proto)
+{
+	//i.e. the transports never take over a file of the user and never wait for a peer past the waiting time
+	int fail_cnt = 0;
+	{
+		//i.e. a native device whose name starts like a backend stays native
+		const struct
+		{
+			const char* name;
+			const char* prefix;
+			bool is_match;
+		} cases[] =
+		{
+			{"loop", LOOP_PREFIX, true},
+			{"loop:baud=115200", LOOP_PREFIX, true},
+			{"loopback0", LOOP_PREFIX, false},
+			{"ptyp0", "pty", false},
+			{"tcpserial", "tcp", false},
+			{"tcp-listen:4000", "tcp", false},
+			{"tcp-listen:4000", "tcp-listen", true},
+		};
+		bool is_pass = true;
+		size_t k = 0;
+		for(k = 0; k < sizeof(cases)/sizeof(cases[0]); k++)
+		{
+			is_pass = (xport_name_is(cases[k].name, cases[k].prefix) == cases[k].is_match)?(is_pass):(false);
+		}
+		printf("xport: %-16s match whole words only %s\n", "prefixes", (is_pass == true)?("pass"):("FAIL"));
+		fail_cnt += (is_pass == true)?(0):(1);
+	}
+#ifndef _WIN32
+	const char* TEXT = "a file of the user\n";
+	char path[64] = {'\0'};
+	snprintf(path, sizeof(path), "/tmp/xmodem6-XXXXXX");
+	int fd = mkstemp(path);
+	if(fd < 0 || write(fd, TEXT, strlen(TEXT)) != (ssize_t)strlen(TEXT))
+	{
+		if(fd >= 0)
+		{
+			close(fd);
+			(void)unlink(path);
+		}
+		return -1;
+	}
+	close(fd);
+	const char* prefixes[] = {"unix-listen:", "pty:"};
+	size_t k = 0;
+	for(k = 0; k < sizeof(prefixes)/sizeof(prefixes[0]); k++)
+	{
+		char name[96] = {'\0'};
+		snprintf(name, sizeof(name), "%s%s", prefixes[k], path);
+		struct xport_t* xp = xport_open(name, 0, proto->verbose, 1000000ULL, proto->keep_xfer_cb);
+		const bool is_pass = (xp == NULL && file_is_intact(path, TEXT) == true)?(true):(false);
+		xport_close(xp);
+		printf("xport: %-16s on a regular file is refused %s\n", prefixes[k], (is_pass == true)?("pass"):("FAIL"));
+		fail_cnt += (is_pass == true)?(0):(1);
+	}
+	(void)unlink(path);
+#endif
+	{
+		uint64_t tsBegin = xport_now_us();
+		struct xport_t* xp = xport_open("tcp-listen:127.0.0.1:0", 0, proto->verbose, 1000000ULL, proto->keep_xfer_cb);
+		uint64_t elapsed = xport_now_us() - tsBegin;
+		const bool is_pass = (xp == NULL && elapsed < 2000000ULL)?(true):(false);
+		xport_close(xp);
+		printf("xport: %-16s without a peer ends in %llu ms %s\n", "tcp-listen:", (unsigned long long)(elapsed / 1000), (is_pass == true)?("pass"):("FAIL"));
+		fail_cnt += (is_pass == true)?(0):(1);
+	}
+	return (fail_cnt == 0)?(0):(-1);
+}
 
 int main(int argc, char* argv[])
 {
 	bool usage = (argc >= 2)?false:true;
 	unsigned long baud = 0;
-	int port_number = 0;
+	char port_name[260] = {'\0'};
 	const short WAITING_TIME_MIN = 1;
 	const short WAITING_TIME_MAX = 1*60*60;
 	const short WAITING_TIME_DFT = 6;
 	short waiting_time = WAITING_TIME_DFT;
 	bool is_query_only = false;
+	bool is_crc_check = false;
+	bool is_mem_check = false;
 	char fn[260] = {'\0'};
+	char fnout[260] = {'\0'};
 	bool is_receiver = false;
 	bool is_xmodem_1k = false;
+	bool is_batch = false;
+	unsigned int flags = 0;
+	unsigned short window = 0;
 	bool verbose = false;
-	const char* fmt = "b:f:p:w:rxvqkh";
+	unsigned int safety_factor = 0;
+	char link_names[STRIPE_LINK_MAX - 1][260]; //i.e. the links after -p, for striping
+	int link_cnt = 0;
+	const char* fmt = "b:f:o:p:l:w:s:n:rxvqkmygeztch";
 	bool has_error = false;
 	int opt = '\0';
 	while((opt = getopt(argc, argv, fmt)) != -1)
@@ -89,7 +616,18 @@ int main(int argc, char* argv[])
 			break;
 			case 'p':
 			{
-				port_number = (int)strtoul(optarg, NULL, 0);
+				port_name_set(port_name, sizeof(port_name), optarg);
+			}
+			break;
+			case 'l':
+			{
+				if(link_cnt >= STRIPE_LINK_MAX - 1)
+				{
+					has_error = true;
+					break;
+				}
+				port_name_set(link_names[link_cnt], sizeof(link_names[link_cnt]), optarg);
+				link_cnt++;
 			}
 			break;
 			case 'w':
@@ -101,12 +639,37 @@ int main(int argc, char* argv[])
 				}
 			}
 			break;
+			case 's':
+			{
+				safety_factor = (unsigned int)strtoul(optarg, NULL, 0);
+				if(safety_factor == 0)
+				{
+					has_error = true;
+				}
+			}
+			break;
+			case 'n':
+			{
+				unsigned long n = strtoul(optarg, NULL, 0);
+				if(n == 0 || n > XMODEM_WINDOW_MAX)
+				{
+					has_error = true;
+				}
+				window = (unsigned short)n;
+			}
+			break;
 			case 'f':
 			{
 				memset(fn, '\0', sizeof(fn));
 				strncpy(fn, optarg, sizeof(fn)-sizeof(char));
 			}
 			break;
+			case 'o':
+			{
+				memset(fnout, '\0', sizeof(fnout));
+				strncpy(fnout, optarg, sizeof(fnout)-sizeof(char));
+			}
+			break;
 			case 'r':
 			{
 				is_receiver = true; //i.e. receiver
@@ -127,6 +690,41 @@ int main(int argc, char* argv[])
 				is_xmodem_1k = true;
 			}
 			break;
+			case 'y':
+			{
+				is_batch = true;
+			}
+			break;
+			case 'g':
+			{
+				flags |= XMODEM_FLAG_STREAM;
+			}
+			break;
+			case 'm':
+			{
+				flags |= XMODEM_FLAG_MMAP;
+			}
+			break;
+			case 'e':
+			{
+				flags |= XMODEM_FLAG_RESUME;
+			}
+			break;
+			case 'z':
+			{
+				flags |= XMODEM_FLAG_COMPRESS;
+			}
+			break;
+			case 'c':
+			{
+				is_crc_check = true;
+			}
+			break;
+			case 't':
+			{
+				is_mem_check = true;
+			}
+			break;
 			case 'v':
 			{
 				verbose = true;
@@ -146,37 +744,82 @@ int main(int argc, char* argv[])
 		}
 	}
 
+	if(link_cnt > 0 && (is_batch == true || (flags & XMODEM_FLAG_RESUME) != 0))
+	{
+		has_error = true;
+	}
+
 	if(usage == true || has_error == true)
 	{
 		printf("xmodem6 [-h]\n");
 		printf("        [-q]\n");
-		printf("        [-v] [-p port_number] [-b baud_rate] [-w waiting_time] [-f fn] [-r|-x] [-k]\n");
+		printf("        [-c]\n");
+		printf("        [-t] [-p loop]\n");
+		printf("        [-v] [-p port] [-b baud_rate] [-w waiting_time] [-s safety_factor] [-f fn] [-o fn] [-r|-x] [-k] [-m] [-g] [-e] [-z] [-n window] [-y [fn ...]]\n");
+		printf("        [-l port ...]\n");
 		printf("\n");
 		printf("        -h             : show usage\n");
 		printf("        -q             : query existing serial port\n");
+		printf("        -c             : check the CRC-16 kernels against the reference and show their throughput\n");
+		printf("        -t             : check the in-memory transfers, buffers and callbacks of the caller as source and sink,\n");
+		printf("                         over the loopback of -p (loop by default), then the transports on files and peers\n");
 		printf("        -v             : verbose\n");
-		printf("        -p port_number : specify serial port number, such as 6 (i.e. \\\\.\\COM6)\n");
+		printf("        -p port        : specify serial port number or name, such as 6 (i.e. \\\\.\\COM6) or /dev/ttyUSB0\n");
+		printf("                         or an in-memory loopback, such as loop:baud=115200,latency=2000,jitter=500,drop=0.0001,flip=0.0001,seed=1\n");
+		printf("                         or a socket, such as tcp:host:port, tcp-listen:port, unix:path or unix-listen:path\n");
+		printf("                         or a new pseudo-terminal, such as pty or pty:/tmp/xmodem (its slave or link is the peer's port)\n");
+		printf("        -l port        : add a link for striping (up to %d with -p), the file of -f is cut into one contiguous\n", STRIPE_LINK_MAX);
+		printf("                         segment per link and they go at once, the receiver needs as many links and puts\n");
+		printf("                         the file together in the directory of -f (or -o), not with -y or -e\n");
 		printf("        -b baud_rate   : specify baud rate, such as 115200\n");
 		printf("        -w waiting_time: specify waiting time in seconds (from %hd to %hd), such as %hd (by default)\n", WAITING_TIME_MIN, WAITING_TIME_MAX, WAITING_TIME_DFT);
+		printf("        -s safety_factor: specify time-out as multiples of the frame time at the baud rate, such as 4 (by default)\n");
 		printf("        -f fn          : specify the filename, such as input.txt or \"C:\\Users\\Leo\\Downloads\\sample data\\output.txt\"\n");
+		printf("        -o fn          : specify the output filename of the loopback receiver\n");
 		printf("        -r             : lauch xmodem receiver\n");
 		printf("        -x             : lauch xmodem transmitter\n");
 		printf("        -k             : lauch xmodem transmitter using XMODEM-1K, otherwise, XMODEM-CRC (by default)\n");
+		printf("        -y             : YMODEM batch, the transmitter sends -f and any further fn in one session,\n");
+		printf("                         and the receiver stores them under their own names in the directory of -f (or -o)\n");
+		printf("        -g             : as the receiver, ask for streaming (YMODEM-G) where frames are not acknowledged,\n");
+		printf("                         only for error-free links such as USB CDC-ACM or TCP, an error aborts the transfer\n");
+		printf("        -n window      : sliding window of frames in flight (from 1 to %d), the receiver asks for it with 'W',\n", XMODEM_WINDOW_MAX);
+		printf("                         and the transmitter answering it sends up to window frames ahead (%d by default)\n", XMODEM_WINDOW_DFT);
+		printf("        -m             : memory-map the file of the transmitter and send blocks straight from it\n");
+		printf("        -e             : as the receiver, keep a checkpoint (fn.ckpt) when a transfer fails, and resume from it\n");
+		printf("                         next time if the transmitter finds the same prefix in its file (not with -y)\n");
+		printf("        -z             : as the transmitter, compress the file on the way (LZ4-style blocks in a container with\n");
+		printf("                         its length), the receiver finds the container and restores the file by itself\n");
 		return EXIT_SUCCESS;
 	}
 
 	if(verbose == true)
 	{
-		sp_verb_set();
-		xmodem_verb_set();
 		log_level_set(LOG_LEVEL_DBG);
 	}
 
-	if(is_query_only == true || port_number == 0)
+	if(is_crc_check == true)
 	{
-		int* port_number_list = NULL;
+		return (crc16_check() == 0)?EXIT_SUCCESS:EXIT_FAILURE;
+	}
+
+	if(is_mem_check == true)
+	{
+		struct xmodem_session_t xs;
+		xmodem_session_init(&xs, NULL, waiting_time, is_xfer_keep);
+		xs.safety_factor = safety_factor;
+		xs.verbose = verbose;
+		const bool is_loop = xport_name_is(port_name, LOOP_PREFIX);
+		int mret = mem_check((is_loop == true)?(port_name):(LOOP_PREFIX), &xs);
+		int pret = xport_check(&xs);
+		return (mret == 0 && pret == 0)?EXIT_SUCCESS:EXIT_FAILURE;
+	}
+
+	if(is_query_only == true || strlen(port_name) == 0)
+	{
+		char** port_name_list = NULL;
 		int port_cnt = 0;
-		int qret = sp_query(&port_number_list, &port_cnt);
+		int qret = xport_query(&port_name_list, &port_cnt, verbose);
 		if(qret == 0)
 		{
 			if(is_query_only == true)
@@ -184,20 +827,20 @@ int main(int argc, char* argv[])
 				int k = 0;
 				for(k = 0; k < port_cnt; k++)
 				{
-					printf("port_number_list[%d] = %d\n", k, port_number_list[k]);
+					printf("port_name_list[%d] = %s\n", k, port_name_list[k]);
 				}
 			}
 			if(port_cnt > 0)
 			{
-				if(port_number == 0)
+				if(strlen(port_name) == 0)
 				{
 					if(is_receiver == true)
 					{
-						port_number = port_number_list[0];
+						strncpy(port_name, port_name_list[0], sizeof(port_name)-sizeof(char));
 					}
 					else
 					{
-						port_number = port_number_list[port_cnt-1];
+						strncpy(port_name, port_name_list[port_cnt-1], sizeof(port_name)-sizeof(char));
 					}
 				}
 			}
@@ -205,17 +848,14 @@ int main(int argc, char* argv[])
 			{
 				log_err("no available serial port (%d)!\n", port_cnt);
 			}
-			if(port_number_list != NULL)
-			{
-				free(port_number_list);
-			}
+			xport_query_release(port_name_list, port_cnt);
 		}
 	}
 
-	log_info("is_query_only = %s; baud = %ld; port_number = %d; waiting_time = %d; is_receiver = %s; is_xmodem_1k = %s, fn = %s\n",
+	log_info("is_query_only = %s; baud = %ld; port_name = %s; waiting_time = %d; is_receiver = %s; is_xmodem_1k = %s, fn = %s\n",
 		is_query_only==true?"true":"false",
 		baud,
-		port_number,
+		port_name,
 		waiting_time,
 		is_receiver==true?"true":"false",
 		is_xmodem_1k==true?"true":"false",
@@ -226,25 +866,98 @@ int main(int argc, char* argv[])
 		return EXIT_SUCCESS;
 	}
 
+#ifdef _WIN32
 	if (!SetConsoleCtrlHandler((PHANDLER_ROUTINE)console_handler,TRUE))
 	{
 		log_err("fail to set signal handler (%p)!\n", console_handler);
 		return EXIT_FAILURE;
 	}
+#else
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = console_handler;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGINT, &sa, NULL) != 0 || sigaction(SIGTERM, &sa, NULL) != 0)
+	{
+		log_err("fail to set signal handler (%p)!\n", console_handler);
+		return EXIT_FAILURE;
+	}
+#endif
+
+	//i.e. the settings of every session, each transfer below runs in a copy of it with its own port
+	struct xmodem_session_t xs;
+	xmodem_session_init(&xs, NULL, waiting_time, is_xfer_keep);
+	xs.flags = flags;
+	xs.window = window;
+	xs.safety_factor = safety_factor;
+	xs.verbose = verbose;
+
+	//i.e. the batch is -f followed by the remaining arguments
+	const char** fns = (const char**)calloc((size_t)argc + 1, sizeof(const char*));
+	int fn_cnt = 0;
+	if(fns == NULL)
+	{
+		return EXIT_FAILURE;
+	}
+	if(strlen(fn) > 0 || is_batch == false)
+	{
+		fns[fn_cnt++] = fn;
+	}
+	while(is_batch == true && optind < argc)
+	{
+		fns[fn_cnt++] = argv[optind++];
+	}
 
 	int xret = -1;
-	HANDLE hComm = sp_open(port_number, baud);
+	if(link_cnt > 0)
+	{
+		const char* names[STRIPE_LINK_MAX];
+		names[0] = port_name;
+		int k = 0;
+		for(k = 0; k < link_cnt; k++)
+		{
+			names[k + 1] = link_names[k];
+		}
+		const bool is_loop = xport_name_is(port_name, LOOP_PREFIX);
+		xret = stripe_xfer(names, link_cnt + 1, baud, &xs, fn, (is_loop == true)?(fnout):(NULL), is_receiver, is_xmodem_1k);
+		free(fns);
+		return (xret == 0)?EXIT_SUCCESS:EXIT_FAILURE;
+	}
+	if(xport_name_is(port_name, LOOP_PREFIX) == true)
+	{
+		xret = loopback_xfer(port_name, baud, &xs, fns, fn_cnt, fnout, is_batch, is_xmodem_1k);
+		free(fns);
+		return (xret == 0)?EXIT_SUCCESS:EXIT_FAILURE;
+	}
 
+	struct xport_t* xp = xport_open(port_name, baud, xs.verbose, (uint64_t)xs.ind_time * 1000000ULL, xs.keep_xfer_cb);
+	if(xp == NULL)
+	{
+		log_err("fail to open port (%s)!\n", port_name);
+		free(fns);
+		return EXIT_FAILURE;
+	}
+
+	xs.xp = xp;
 	if(is_receiver == true)
 	{
-		xret = xmodem_receive(hComm, waiting_time, fn, is_xfer_keep);
+		xret = (is_batch == true)?(xmodem_receive_batch(&xs, fn)):(xmodem_receive(&xs, fn));
 	}
 	else
 	{
-		xret = xmodem_transmit(hComm, waiting_time, fn, is_xmodem_1k, is_xfer_keep);
+		xret = (is_batch == true)?(xmodem_transmit_batch(&xs, fns, fn_cnt, is_xmodem_1k)):(xmodem_transmit(&xs, fn, is_xmodem_1k));
 	}
+	free(fns);
+
+	struct xmodem_rtt_t rtt;
+	xmodem_session_rtt(&xs, &rtt);
+	log_info("srtt = %llu us; rttvar = %llu us; rto = %llu us; samples = %lu\n",
+		(unsigned long long)rtt.srtt_us,
+		(unsigned long long)rtt.rttvar_us,
+		(unsigned long long)rtt.rto_us,
+		rtt.samples);
 
-	sp_close(hComm);
+	xport_close(xp);
 
 	log_dbg("xret = %d\n", xret);
 
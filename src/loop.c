@@ -0,0 +1,410 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "loop.h"
+
+#define LOOP_BUF_SZ 65536 //NOTE: a writer waits, up to tx_timeout_us, once this many bytes are in flight
+
+struct loop_chan_t
+{
+	unsigned char data[LOOP_BUF_SZ];
+	uint64_t due_ns[LOOP_BUF_SZ]; //i.e. when each byte arrives at the far end
+	size_t head;
+	size_t cnt;
+	uint64_t wire_free_ns;
+	uint64_t due_last_ns;
+	uint64_t rng;
+	bool closed;
+};
+
+struct loop_link_t
+{
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	clockid_t clk;
+	struct loop_model_t model;
+	uint64_t byte_ns;
+	struct loop_chan_t chan[2]; //i.e. chan[0] carries a to b, chan[1] carries b to a
+	char name[260];
+	int refs;
+	struct loop_link_t* next;
+};
+
+struct loop_end_t
+{
+	struct loop_link_t* link;
+	int side;
+};
+
+static pthread_mutex_t loop_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct loop_link_t* loop_pending = NULL; //i.e. links whose second end is not opened yet
+
+static uint64_t loop_rand(uint64_t* state)
+{
+	//i.e. xorshift64*, it is deterministic for a given seed
+	uint64_t x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+static double loop_rand_unit(uint64_t* state)
+{
+	return (double)(loop_rand(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static uint64_t loop_now_ns(void)
+{
+	return xport_now_us() * 1000ULL;
+}
+
+int loop_model_parse(struct loop_model_t* model, const char* spec)
+{
+	//i.e. "loop" or "loop:baud=115200,latency=2000,jitter=500,drop=0.0001,flip=0.0001,seed=1"
+	memset(model, 0, sizeof(struct loop_model_t));
+	model->seed = 1;
+	if(strncmp(spec, LOOP_PREFIX, strlen(LOOP_PREFIX)) != 0)
+	{
+		return -1;
+	}
+	const char* p = spec + strlen(LOOP_PREFIX);
+	if(*p == '\0')
+	{
+		return 0;
+	}
+	if(*p != ':')
+	{
+		return -1;
+	}
+	p++;
+	while(*p != '\0')
+	{
+		char key[32] = {'\0'};
+		size_t k = 0;
+		while(*p != '\0' && *p != '=' && k < sizeof(key) - 1)
+		{
+			key[k++] = *p++;
+		}
+		if(*p != '=')
+		{
+			return -1;
+		}
+		p++;
+		char* end = NULL;
+		double value = strtod(p, &end);
+		if(end == p || value < 0)
+		{
+			return -1;
+		}
+		p = end;
+		if(strcmp(key, "baud") == 0)
+		{
+			model->baud = (unsigned long)value;
+		}
+		else if(strcmp(key, "latency") == 0)
+		{
+			model->latency_us = (unsigned long)value;
+		}
+		else if(strcmp(key, "jitter") == 0)
+		{
+			model->jitter_us = (unsigned long)value;
+		}
+		else if(strcmp(key, "drop") == 0)
+		{
+			model->drop_rate = value;
+		}
+		else if(strcmp(key, "flip") == 0)
+		{
+			model->flip_rate = value;
+		}
+		else if(strcmp(key, "seed") == 0)
+		{
+			model->seed = (unsigned long)value;
+		}
+		else
+		{
+			return -1;
+		}
+		if(*p == ',')
+		{
+			p++;
+		}
+		else if(*p != '\0')
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static struct loop_link_t* loop_link_create(const char* name, unsigned long baud)
+{
+	struct loop_link_t* link = (struct loop_link_t*)calloc(1, sizeof(struct loop_link_t));
+	if(link == NULL)
+	{
+		return NULL;
+	}
+	if(loop_model_parse(&link->model, name) != 0)
+	{
+		free(link);
+		return NULL;
+	}
+	if(link->model.baud == 0)
+	{
+		link->model.baud = baud;
+	}
+	link->byte_ns = (link->model.baud == 0)?(0):(10ULL * 1000000000ULL / link->model.baud);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	link->clk = CLOCK_MONOTONIC;
+	if(pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0)
+	{
+		link->clk = CLOCK_REALTIME;
+	}
+	pthread_mutex_init(&link->lock, NULL);
+	pthread_cond_init(&link->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	int k = 0;
+	for(k = 0; k < 2; k++)
+	{
+		link->chan[k].rng = (link->model.seed + 1) * 0x9E3779B97F4A7C15ULL + k;
+	}
+	snprintf(link->name, sizeof(link->name), "%s", name);
+	return link;
+}
+
+static int loop_xport_open(struct xport_t* xp, const char* name, unsigned long baud)
+{
+	//i.e. the first open of a name creates the link (end a), the second one attaches to it (end b)
+	struct loop_end_t* end = (struct loop_end_t*)calloc(1, sizeof(struct loop_end_t));
+	if(end == NULL)
+	{
+		return -1;
+	}
+	pthread_mutex_lock(&loop_registry_lock);
+	struct loop_link_t** iter = &loop_pending;
+	while(*iter != NULL && strcmp((*iter)->name, name) != 0)
+	{
+		iter = &(*iter)->next;
+	}
+	if(*iter != NULL)
+	{
+		end->link = *iter;
+		end->side = 1;
+		*iter = end->link->next;
+		end->link->next = NULL;
+	}
+	else
+	{
+		end->link = loop_link_create(name, baud);
+		end->side = 0;
+		if(end->link != NULL)
+		{
+			end->link->next = loop_pending;
+			loop_pending = end->link;
+		}
+	}
+	if(end->link != NULL)
+	{
+		end->link->refs++;
+	}
+	pthread_mutex_unlock(&loop_registry_lock);
+	if(end->link == NULL)
+	{
+		free(end);
+		return -1;
+	}
+	const struct loop_model_t* model = &end->link->model;
+	xp->priv = (void*)end;
+	xp->baud = model->baud;
+	xp->caps = XPORT_CAP_WAIT;
+	if(model->baud != 0)
+	{
+		xp->caps |= XPORT_CAP_BAUD;
+	}
+	if(model->drop_rate == 0 && model->flip_rate == 0)
+	{
+		xp->caps |= XPORT_CAP_RELIABLE;
+	}
+	return 0;
+}
+
+static int loop_xport_read(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ)
+{
+	struct loop_end_t* end = (struct loop_end_t*)xp->priv;
+	struct loop_link_t* link = end->link;
+	struct loop_chan_t* chan = &link->chan[1 - end->side];
+	size_t n = 0;
+	pthread_mutex_lock(&link->lock);
+	uint64_t now = loop_now_ns();
+	while(n < BUF_SZ && chan->cnt > 0 && chan->due_ns[chan->head] <= now)
+	{
+		buf[n++] = chan->data[chan->head];
+		chan->head = (chan->head + 1) % LOOP_BUF_SZ;
+		chan->cnt--;
+	}
+	int ret = (int)n;
+	if(n > 0)
+	{
+		pthread_cond_broadcast(&link->cond);
+	}
+	else if(chan->cnt == 0 && chan->closed == true)
+	{
+		ret = -1; //i.e. the far end is gone, the same as EIO on a pty
+	}
+	pthread_mutex_unlock(&link->lock);
+	return ret;
+}
+
+static void loop_timed_wait(struct loop_link_t* link, const uint64_t wake_ns)
+{
+	//i.e. wake_ns is on the xport_now_us clock, the condition variable may use another one
+	uint64_t now = loop_now_ns();
+	uint64_t delta = (wake_ns > now)?(wake_ns - now):(0);
+	struct timespec ts = {0};
+	clock_gettime(link->clk, &ts);
+	uint64_t abs_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec + delta;
+	ts.tv_sec = abs_ns / 1000000000ULL;
+	ts.tv_nsec = abs_ns % 1000000000ULL;
+	(void)pthread_cond_timedwait(&link->cond, &link->lock, &ts);
+}
+
+static int loop_xport_write(struct xport_t* xp, const unsigned char* buf, const size_t BUF_SZ)
+{
+	struct loop_end_t* end = (struct loop_end_t*)xp->priv;
+	struct loop_link_t* link = end->link;
+	const struct loop_model_t* model = &link->model;
+	struct loop_chan_t* chan = &link->chan[end->side];
+	size_t k = 0;
+	int ret = (int)BUF_SZ;
+	//NOTE: the same as a full tty or socket, a peer which stops reading fails the write after tx_timeout_us
+	const uint64_t deadline_ns = loop_now_ns() + xp->tx_timeout_us * 1000ULL;
+	pthread_mutex_lock(&link->lock);
+	for(k = 0; k < BUF_SZ; k++)
+	{
+		while(chan->cnt >= LOOP_BUF_SZ && link->chan[1 - end->side].closed == false && loop_now_ns() < deadline_ns)
+		{
+			loop_timed_wait(link, deadline_ns);
+		}
+		if(link->chan[1 - end->side].closed == true || chan->cnt >= LOOP_BUF_SZ)
+		{
+			ret = -1;
+			break;
+		}
+		//i.e. bytes leave one after another at the baud rate, then take latency plus jitter
+		uint64_t now = loop_now_ns();
+		uint64_t start = (chan->wire_free_ns > now)?(chan->wire_free_ns):(now);
+		chan->wire_free_ns = start + link->byte_ns;
+		uint64_t due = chan->wire_free_ns + (uint64_t)model->latency_us * 1000ULL;
+		if(model->jitter_us > 0)
+		{
+			due += loop_rand(&chan->rng) % ((uint64_t)model->jitter_us * 1000ULL + 1);
+		}
+		if(due < chan->due_last_ns)
+		{
+			due = chan->due_last_ns; //NOTE: a serial line never reorders bytes
+		}
+		chan->due_last_ns = due;
+		if(model->drop_rate > 0 && loop_rand_unit(&chan->rng) < model->drop_rate)
+		{
+			continue;
+		}
+		unsigned char ch = buf[k];
+		if(model->flip_rate > 0 && loop_rand_unit(&chan->rng) < model->flip_rate)
+		{
+			ch ^= (unsigned char)(1 << (loop_rand(&chan->rng) % 8));
+		}
+		size_t tail = (chan->head + chan->cnt) % LOOP_BUF_SZ;
+		chan->data[tail] = ch;
+		chan->due_ns[tail] = due;
+		chan->cnt++;
+	}
+	pthread_cond_broadcast(&link->cond);
+	pthread_mutex_unlock(&link->lock);
+	return ret;
+}
+
+static int loop_xport_wait(struct xport_t* xp, const uint64_t timeout_us)
+{
+	struct loop_end_t* end = (struct loop_end_t*)xp->priv;
+	struct loop_link_t* link = end->link;
+	struct loop_chan_t* chan = &link->chan[1 - end->side];
+	const uint64_t deadline = loop_now_ns() + timeout_us * 1000ULL;
+	int ret = 0;
+	pthread_mutex_lock(&link->lock);
+	while(1)
+	{
+		uint64_t now = loop_now_ns();
+		if(chan->cnt > 0 && chan->due_ns[chan->head] <= now)
+		{
+			ret = 1;
+			break;
+		}
+		if(chan->cnt == 0 && chan->closed == true)
+		{
+			ret = -1;
+			break;
+		}
+		if(now >= deadline)
+		{
+			ret = 0;
+			break;
+		}
+		uint64_t wake = deadline;
+		if(chan->cnt > 0 && chan->due_ns[chan->head] < wake)
+		{
+			wake = chan->due_ns[chan->head];
+		}
+		loop_timed_wait(link, wake);
+	}
+	pthread_mutex_unlock(&link->lock);
+	return ret;
+}
+
+static void loop_xport_close(struct xport_t* xp)
+{
+	struct loop_end_t* end = (struct loop_end_t*)xp->priv;
+	struct loop_link_t* link = end->link;
+	bool is_last = false;
+	pthread_mutex_lock(&loop_registry_lock);
+	struct loop_link_t** iter = &loop_pending;
+	while(*iter != NULL && *iter != link)
+	{
+		iter = &(*iter)->next;
+	}
+	if(*iter != NULL)
+	{
+		*iter = link->next;
+	}
+	pthread_mutex_lock(&link->lock);
+	link->chan[end->side].closed = true;
+	link->refs--;
+	is_last = (link->refs == 0)?(true):(false);
+	pthread_cond_broadcast(&link->cond);
+	pthread_mutex_unlock(&link->lock);
+	pthread_mutex_unlock(&loop_registry_lock);
+	if(is_last == true)
+	{
+		pthread_cond_destroy(&link->cond);
+		pthread_mutex_destroy(&link->lock);
+		free(link);
+	}
+	free(end);
+}
+
+const struct xport_ops_t loop_xport_ops =
+{
+	.name = "loop",
+	.prefix = LOOP_PREFIX,
+	.open = loop_xport_open,
+	.read = loop_xport_read,
+	.write = loop_xport_write,
+	.wait = loop_xport_wait,
+	.close = loop_xport_close,
+};
@@ -0,0 +1,485 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include "lz.h"
+#include "crc16.h"
+
+#define LZ_VERSION       1
+#define LZ_MIN_MATCH     4
+#define LZ_HASH_BITS     12
+#define LZ_LAST_LITERALS 5  //i.e. as in LZ4, a block ends with literals
+#define LZ_MF_LIMIT      12 //i.e. as in LZ4, no match starts this close to the end of a block
+#define LZ_BLK_RAW       0x80000000UL //i.e. in the block header, the block did not get smaller and is stored as it is
+
+static const uint8_t lz_magic[4] = {'X', '6', 'L', 'Z'};
+
+static uint32_t lz_read32(const uint8_t* p)
+{
+	uint32_t v = 0;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t lz_hash(const uint32_t v)
+{
+	return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t* lz_put_len(uint8_t* op, const uint8_t* oend, size_t len)
+{
+	//i.e. the part of a length beyond 15 in bytes of 255, NULL when it does not fit
+	while(len >= 255)
+	{
+		if(op >= oend)
+		{
+			return NULL;
+		}
+		*op++ = 255;
+		len -= 255;
+	}
+	if(op >= oend)
+	{
+		return NULL;
+	}
+	*op++ = (uint8_t)len;
+	return op;
+}
+
+static uint8_t* lz_put_seq(uint8_t* op, const uint8_t* oend, const uint8_t* lit, const size_t lit_len, const size_t off, const size_t match_len)
+{
+	//i.e. token, literals, then offset and match length unless it is the last sequence (off == 0)
+	if(op >= oend)
+	{
+		return NULL;
+	}
+	uint8_t* token = op++;
+	*token = (uint8_t)(((lit_len >= 15)?(15):(lit_len)) << 4);
+	if(lit_len >= 15 && (op = lz_put_len(op, oend, lit_len - 15)) == NULL)
+	{
+		return NULL;
+	}
+	if((size_t)(oend - op) < lit_len + ((off > 0)?(2):(0)))
+	{
+		return NULL;
+	}
+	memcpy(op, lit, lit_len);
+	op += lit_len;
+	if(off == 0)
+	{
+		return op;
+	}
+	*op++ = (uint8_t)(off & 0xff); //i.e. little-endian, as in LZ4
+	*op++ = (uint8_t)(off >> 8);
+	const size_t ml = match_len - LZ_MIN_MATCH;
+	*token |= (uint8_t)((ml >= 15)?(15):(ml));
+	if(ml >= 15)
+	{
+		op = lz_put_len(op, oend, ml - 15);
+	}
+	return op;
+}
+
+size_t lz_block_compress(const uint8_t* src, const size_t len, uint8_t* dst, const size_t cap)
+{
+	//i.e. greedy, one candidate per hash, 0 when the result does not fit in cap
+	uint16_t table[1 << LZ_HASH_BITS];
+	memset(table, 0, sizeof(table));
+	const uint8_t* ip = src;
+	const uint8_t* anchor = src;
+	const uint8_t* iend = src + len;
+	uint8_t* op = dst;
+	const uint8_t* oend = dst + cap;
+	if(len > LZ_BLOCK_SZ)
+	{
+		return 0;
+	}
+	if(len > LZ_MF_LIMIT)
+	{
+		const uint8_t* mflimit = iend - LZ_MF_LIMIT;
+		const uint8_t* matchlimit = iend - LZ_LAST_LITERALS;
+		ip++;
+		while(ip < mflimit)
+		{
+			const uint32_t h = lz_hash(lz_read32(ip));
+			const uint8_t* ref = src + table[h];
+			table[h] = (uint16_t)(ip - src);
+			if(ref >= ip || lz_read32(ref) != lz_read32(ip))
+			{
+				ip++;
+				continue;
+			}
+			while(ip > anchor && ref > src && ip[-1] == ref[-1])
+			{
+				ip--;
+				ref--;
+			}
+			const uint8_t* mp = ip + LZ_MIN_MATCH;
+			const uint8_t* mr = ref + LZ_MIN_MATCH;
+			while(mp < matchlimit && *mp == *mr)
+			{
+				mp++;
+				mr++;
+			}
+			op = lz_put_seq(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), (size_t)(mp - ip));
+			if(op == NULL)
+			{
+				return 0;
+			}
+			ip = mp;
+			anchor = ip;
+			if(ip < mflimit)
+			{
+				table[lz_hash(lz_read32(ip - 2))] = (uint16_t)(ip - 2 - src);
+			}
+		}
+	}
+	op = lz_put_seq(op, oend, anchor, (size_t)(iend - anchor), 0, 0);
+	return (op == NULL)?(0):((size_t)(op - dst));
+}
+
+int lz_block_decompress(const uint8_t* src, const size_t len, uint8_t* dst, const size_t cap)
+{
+	//i.e. every length and offset is checked, so a damaged block fails instead of writing out of bounds
+	const uint8_t* ip = src;
+	const uint8_t* iend = src + len;
+	uint8_t* op = dst;
+	const uint8_t* oend = dst + cap;
+	while(ip < iend)
+	{
+		const uint8_t token = *ip++;
+		size_t lit_len = token >> 4;
+		uint8_t b = 0;
+		if(lit_len == 15)
+		{
+			do
+			{
+				if(ip >= iend)
+				{
+					return -1;
+				}
+				b = *ip++;
+				lit_len += b;
+			} while(b == 255);
+		}
+		if(lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op))
+		{
+			return -1;
+		}
+		memcpy(op, ip, lit_len);
+		op += lit_len;
+		ip += lit_len;
+		if(ip == iend)
+		{
+			break; //i.e. the last sequence has literals only
+		}
+		if(iend - ip < 2)
+		{
+			return -1;
+		}
+		const size_t off = (size_t)ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		if(off == 0 || off > (size_t)(op - dst))
+		{
+			return -1;
+		}
+		size_t match_len = token & 0xf;
+		if(match_len == 15)
+		{
+			do
+			{
+				if(ip >= iend)
+				{
+					return -1;
+				}
+				b = *ip++;
+				match_len += b;
+			} while(b == 255);
+		}
+		match_len += LZ_MIN_MATCH;
+		if(match_len > (size_t)(oend - op))
+		{
+			return -1;
+		}
+		const uint8_t* ref = op - off;
+		if(off >= match_len)
+		{
+			memcpy(op, ref, match_len);
+			op += match_len;
+		}
+		else
+		{
+			//NOTE: the match overlaps its own output, so it is copied byte by byte
+			size_t k = 0;
+			for(k = 0; k < match_len; k++)
+			{
+				*op++ = *ref++;
+			}
+		}
+	}
+	return (int)(op - dst);
+}
+
+static void lz_hdr_build(uint8_t* hdr, const uint64_t orig_len)
+{
+	memcpy(hdr, lz_magic, sizeof(lz_magic));
+	hdr[4] = LZ_VERSION;
+	hdr[5] = 0;
+	int k = 0;
+	for(k = 0; k < 8; k++)
+	{
+		hdr[6 + k] = (uint8_t)(orig_len >> (56 - 8 * k));
+	}
+	uint16_t crc16 = crc16_update(0, hdr, LZ_HDR_SZ - 2);
+	hdr[14] = (uint8_t)(crc16 >> 8);
+	hdr[15] = (uint8_t)(crc16 & 0xff);
+}
+
+int lz_probe(const uint8_t* data, const size_t len, uint64_t* orig_len)
+{
+	//i.e. 1 when data starts with a container header, which is guarded by its CRC so a plain file is not mistaken for one
+	if(len < LZ_HDR_SZ || memcmp(data, lz_magic, sizeof(lz_magic)) != 0 || data[4] != LZ_VERSION)
+	{
+		return 0;
+	}
+	uint16_t crc16 = crc16_update(0, data, LZ_HDR_SZ - 2);
+	if(data[14] != (uint8_t)(crc16 >> 8) || data[15] != (uint8_t)(crc16 & 0xff))
+	{
+		return 0;
+	}
+	uint64_t v = 0;
+	int k = 0;
+	for(k = 0; k < 8; k++)
+	{
+		v = (v << 8) | data[6 + k];
+	}
+	*orig_len = v;
+	return 1;
+}
+
+struct lz_enc_t
+{
+	lz_read_fn* rd;
+	void* ctx;
+	uint64_t left;  //i.e. original bytes not taken yet
+	size_t out_len;
+	size_t out_pos;
+	uint8_t in[LZ_BLOCK_SZ];
+	uint8_t out[LZ_HDR_SZ + 4 + LZ_BLOCK_SZ]; //i.e. the header, or one block with its own header
+};
+
+struct lz_enc_t* lz_enc_open(lz_read_fn* rd, void* ctx, const uint64_t orig_len)
+{
+	struct lz_enc_t* enc = (struct lz_enc_t*)calloc(1, sizeof(struct lz_enc_t));
+	if(enc == NULL)
+	{
+		return NULL;
+	}
+	enc->rd = rd;
+	enc->ctx = ctx;
+	enc->left = orig_len;
+	lz_hdr_build(enc->out, orig_len);
+	enc->out_len = LZ_HDR_SZ;
+	enc->out_pos = 0;
+	return enc;
+}
+
+static int lz_enc_fill(struct lz_enc_t* enc)
+{
+	//i.e. the next block of the container, 0 at its end
+	const size_t want = (enc->left < LZ_BLOCK_SZ)?((size_t)enc->left):(LZ_BLOCK_SZ);
+	size_t got = 0;
+	while(got < want)
+	{
+		int rret = enc->rd(enc->ctx, &enc->in[got], want - got);
+		if(rret <= 0)
+		{
+			break;
+		}
+		got += rret;
+	}
+	if(got < want)
+	{
+		return -1; //i.e. the file is shorter than the header says, or it can not be read
+	}
+	size_t n = (got == 0)?(0):(lz_block_compress(enc->in, got, &enc->out[4], got - 1));
+	uint32_t blk_hdr = (uint32_t)n;
+	if(n == 0)
+	{
+		memcpy(&enc->out[4], enc->in, got);
+		n = got;
+		blk_hdr = (uint32_t)(LZ_BLK_RAW | got);
+	}
+	enc->out[0] = (uint8_t)(blk_hdr >> 24);
+	enc->out[1] = (uint8_t)(blk_hdr >> 16);
+	enc->out[2] = (uint8_t)(blk_hdr >> 8);
+	enc->out[3] = (uint8_t)(blk_hdr & 0xff);
+	enc->out_len = (got == 0)?(0):(4 + n);
+	enc->out_pos = 0;
+	enc->left -= got;
+	return (int)enc->out_len;
+}
+
+int lz_enc_read(struct lz_enc_t* enc, uint8_t* buf, const size_t BUF_SZ)
+{
+	//i.e. like a file read, BUF_SZ bytes of the container unless it ends, 0 at the end, -1 on error
+	size_t done = 0;
+	while(done < BUF_SZ)
+	{
+		if(enc->out_pos == enc->out_len)
+		{
+			if(enc->left == 0)
+			{
+				break;
+			}
+			if(lz_enc_fill(enc) < 0)
+			{
+				return -1;
+			}
+		}
+		size_t cnt = enc->out_len - enc->out_pos;
+		if(cnt > BUF_SZ - done)
+		{
+			cnt = BUF_SZ - done;
+		}
+		memcpy(&buf[done], &enc->out[enc->out_pos], cnt);
+		enc->out_pos += cnt;
+		done += cnt;
+	}
+	return (int)done;
+}
+
+void lz_enc_close(struct lz_enc_t* enc)
+{
+	free(enc);
+}
+
+enum lz_dec_part_t
+{
+	lz_dec_part_hdr = 0,
+	lz_dec_part_blk_hdr,
+	lz_dec_part_blk,
+	lz_dec_part_done,
+};
+
+struct lz_dec_t
+{
+	lz_write_fn* wr;
+	void* ctx;
+	enum lz_dec_part_t part;
+	uint64_t left;   //i.e. original bytes still to come, from the header
+	uint32_t blk_hdr;
+	size_t need;     //i.e. size of the part being collected
+	size_t in_len;
+	uint8_t in[LZ_BLOCK_SZ];
+	uint8_t out[LZ_BLOCK_SZ];
+};
+
+struct lz_dec_t* lz_dec_open(lz_write_fn* wr, void* ctx)
+{
+	struct lz_dec_t* dec = (struct lz_dec_t*)calloc(1, sizeof(struct lz_dec_t));
+	if(dec == NULL)
+	{
+		return NULL;
+	}
+	dec->wr = wr;
+	dec->ctx = ctx;
+	dec->part = lz_dec_part_hdr;
+	dec->need = LZ_HDR_SZ;
+	return dec;
+}
+
+static int lz_dec_part(struct lz_dec_t* dec)
+{
+	//i.e. a part is complete in dec->in, the original bytes of a block go out at once
+	switch(dec->part)
+	{
+		case lz_dec_part_hdr:
+		{
+			if(lz_probe(dec->in, dec->in_len, &dec->left) != 1)
+			{
+				return -1;
+			}
+			dec->part = (dec->left == 0)?(lz_dec_part_done):(lz_dec_part_blk_hdr);
+			dec->need = 4;
+		}
+		break;
+		case lz_dec_part_blk_hdr:
+		{
+			dec->blk_hdr = ((uint32_t)dec->in[0] << 24) | ((uint32_t)dec->in[1] << 16) | ((uint32_t)dec->in[2] << 8) | dec->in[3];
+			dec->need = dec->blk_hdr & ~LZ_BLK_RAW;
+			if(dec->need == 0 || dec->need > LZ_BLOCK_SZ)
+			{
+				return -1;
+			}
+			dec->part = lz_dec_part_blk;
+		}
+		break;
+		case lz_dec_part_blk:
+		{
+			const size_t raw_len = (dec->left < LZ_BLOCK_SZ)?((size_t)dec->left):(LZ_BLOCK_SZ);
+			if(dec->blk_hdr & LZ_BLK_RAW)
+			{
+				if(dec->in_len != raw_len || dec->wr(dec->ctx, dec->in, raw_len) != 0)
+				{
+					return -1;
+				}
+			}
+			else
+			{
+				int dret = lz_block_decompress(dec->in, dec->in_len, dec->out, sizeof(dec->out));
+				if(dret != (int)raw_len || dec->wr(dec->ctx, dec->out, raw_len) != 0)
+				{
+					return -1;
+				}
+			}
+			dec->left -= raw_len;
+			dec->part = (dec->left == 0)?(lz_dec_part_done):(lz_dec_part_blk_hdr);
+			dec->need = 4;
+		}
+		break;
+		case lz_dec_part_done:
+		default:
+		{
+			//do nothing
+		}
+		break;
+	}
+	dec->in_len = 0;
+	return 0;
+}
+
+int lz_dec_write(struct lz_dec_t* dec, const uint8_t* data, const size_t len)
+{
+	//i.e. container bytes in runs of any size, what follows its end (such as padding) is ignored
+	size_t done = 0;
+	while(done < len && dec->part != lz_dec_part_done)
+	{
+		size_t cnt = dec->need - dec->in_len;
+		if(cnt > len - done)
+		{
+			cnt = len - done;
+		}
+		memcpy(&dec->in[dec->in_len], &data[done], cnt);
+		dec->in_len += cnt;
+		done += cnt;
+		if(dec->in_len == dec->need && lz_dec_part(dec) != 0)
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int lz_dec_close(struct lz_dec_t* dec)
+{
+	//i.e. 0 only when the whole original was restored
+	if(dec == NULL)
+	{
+		return -1;
+	}
+	int cret = (dec->part == lz_dec_part_done)?(0):(-1);
+	free(dec);
+	return cret;
+}
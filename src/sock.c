@@ -0,0 +1,544 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#endif
+
+#include "sock.h"
+
+#ifdef _WIN32
+typedef SOCKET sock_fd_t;
+#define SOCK_INVALID INVALID_SOCKET
+#define sock_close(fd) closesocket(fd)
+#define sock_errno() WSAGetLastError()
+#define sock_poll(pfd, n, ms) WSAPoll(pfd, n, ms)
+#define SOCK_EAGAIN(e) ((e) == WSAEWOULDBLOCK)
+#define SOCK_EINTR(e) ((e) == WSAEINTR)
+#else
+typedef int sock_fd_t;
+#define SOCK_INVALID (-1)
+#define sock_close(fd) close(fd)
+#define sock_errno() (errno)
+#define sock_poll(pfd, n, ms) poll(pfd, n, ms)
+#define SOCK_EAGAIN(e) ((e) == EAGAIN || (e) == EWOULDBLOCK)
+#define SOCK_EINTR(e) ((e) == EINTR)
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define SOCK_SEND_FLAGS MSG_NOSIGNAL //i.e. a dropped peer is an error, not a SIGPIPE
+#else
+#define SOCK_SEND_FLAGS 0
+#endif
+
+#define SOCK_ACCEPT_SLICE 100 //i.e. in ms, how often a listener waiting for its peer asks keep_cb
+#define ms_to_us(ms) ((uint64_t)(ms) * 1000ULL)
+
+#define sock_printf(verbose, fmt, ...) \
+	do { if((verbose) == true) printf(fmt, __VA_ARGS__); } while(0)
+
+static int sock_startup(void)
+{
+#ifdef _WIN32
+	WSADATA wsaData;
+	if(WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+static void sock_cleanup(void)
+{
+#ifdef _WIN32
+	(void)WSACleanup();
+#endif
+}
+
+static int sock_nonblock(sock_fd_t fd)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	return (ioctlsocket(fd, FIONBIO, &mode) == 0)?(0):(-1);
+#else
+	int flags = fcntl(fd, F_GETFL, 0);
+	if(flags < 0)
+	{
+		return -1;
+	}
+	return (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0)?(0):(-1);
+#endif
+}
+
+static void sock_tune(sock_fd_t fd, bool is_tcp, const bool verbose)
+{
+	//i.e. every XMODEM frame and every ACK/NAK is one small write that the peer is waiting for
+	int bufsz = SOCK_BUF_SZ;
+	(void)setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (const char*)&bufsz, sizeof(bufsz));
+	(void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const char*)&bufsz, sizeof(bufsz));
+	if(is_tcp == true)
+	{
+		int on = 1;
+		if(setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on)) != 0)
+		{
+			sock_printf(verbose, "[%s] TCP_NODELAY, errno = %d\n", __FUNCTION__, sock_errno());
+		}
+#ifdef TCP_QUICKACK
+		(void)setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, (const char*)&on, sizeof(on));
+#endif
+	}
+}
+
+static int sock_split(const char* addr, char* host, const size_t HOST_SZ, char* port, const size_t PORT_SZ)
+{
+	//i.e. "host:port", "[v6]:port" or "port", an empty host means any (listen) or localhost (connect)
+	const char* colon = strrchr(addr, ':');
+	const char* h = addr;
+	size_t hlen = 0;
+	if(colon != NULL)
+	{
+		hlen = (size_t)(colon - addr);
+		if(hlen >= 2 && h[0] == '[' && h[hlen-1] == ']')
+		{
+			h++;
+			hlen -= 2;
+		}
+		snprintf(port, PORT_SZ, "%s", colon + 1);
+	}
+	else
+	{
+		snprintf(port, PORT_SZ, "%s", addr);
+	}
+	if(hlen >= HOST_SZ || strlen(port) == 0)
+	{
+		return -1;
+	}
+	memcpy(host, h, hlen);
+	host[hlen] = '\0';
+	return 0;
+}
+
+static sock_fd_t sock_tcp_open(const char* addr, bool is_listen, const bool verbose)
+{
+	char host[256] = {'\0'};
+	char port[32] = {'\0'};
+	if(sock_split(addr, host, sizeof(host), port, sizeof(port)) != 0)
+	{
+		sock_printf(verbose, "[%s] bad address = %s\n", __FUNCTION__, addr);
+		return SOCK_INVALID;
+	}
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = (is_listen == true)?(AI_PASSIVE):(0);
+	struct addrinfo* res = NULL;
+	int gret = getaddrinfo((strlen(host) > 0)?(host):(NULL), port, &hints, &res);
+	if(gret != 0)
+	{
+		sock_printf(verbose, "[%s] getaddrinfo(%s), ret = %d\n", __FUNCTION__, addr, gret);
+		return SOCK_INVALID;
+	}
+	sock_fd_t fd = SOCK_INVALID;
+	struct addrinfo* ai = NULL;
+	for(ai = res; ai != NULL; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if(fd == SOCK_INVALID)
+		{
+			continue;
+		}
+		if(is_listen == true)
+		{
+			int on = 1;
+			(void)setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+			//i.e. buffer sizes are inherited by the accepted socket, and must be set before the handshake
+			sock_tune(fd, true, verbose);
+			if(bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 1) == 0)
+			{
+				break;
+			}
+		}
+		else
+		{
+			sock_tune(fd, true, verbose);
+			if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			{
+				break;
+			}
+		}
+		sock_printf(verbose, "[%s] %s, errno = %d\n", __FUNCTION__, addr, sock_errno());
+		sock_close(fd);
+		fd = SOCK_INVALID;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+#ifndef _WIN32
+static sock_fd_t sock_unix_open(const char* path, bool is_listen, const bool verbose)
+{
+	struct sockaddr_un sun;
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if(strlen(path) == 0 || strlen(path) >= sizeof(sun.sun_path))
+	{
+		sock_printf(verbose, "[%s] bad path = %s\n", __FUNCTION__, path);
+		return SOCK_INVALID;
+	}
+	memcpy(sun.sun_path, path, strlen(path));
+	sock_fd_t fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == SOCK_INVALID)
+	{
+		return SOCK_INVALID;
+	}
+	sock_tune(fd, false, verbose);
+	int ret = -1;
+	if(is_listen == true)
+	{
+		//i.e. only a stale node left behind by an earlier listener is removed, never a file of the user
+		struct stat st;
+		if(lstat(path, &st) == 0)
+		{
+			if(S_ISSOCK(st.st_mode) == 0)
+			{
+				printf("unix: path = %s is there and is not a socket, it is left alone\n", path);
+				sock_close(fd);
+				return SOCK_INVALID;
+			}
+			(void)unlink(path);
+		}
+		ret = (bind(fd, (struct sockaddr*)&sun, sizeof(sun)) == 0 && listen(fd, 1) == 0)?(0):(-1);
+	}
+	else
+	{
+		ret = connect(fd, (struct sockaddr*)&sun, sizeof(sun));
+	}
+	if(ret != 0)
+	{
+		sock_printf(verbose, "[%s] %s, errno = %d\n", __FUNCTION__, path, sock_errno());
+		sock_close(fd);
+		return SOCK_INVALID;
+	}
+	return fd;
+}
+#endif
+
+static sock_fd_t sock_accept(sock_fd_t lfd, bool is_tcp, const struct xport_t* xp)
+{
+	//i.e. serve exactly one peer, so the listening socket is closed at once
+	//NOTE: the peer is waited for as long as the open allows, and in slices so keep_cb can stop it
+	const bool verbose = xp->verbose;
+	const uint64_t deadline = xport_now_us() + xp->open_timeout_us;
+	sock_fd_t fd = SOCK_INVALID;
+	while(xp->keep_cb == NULL || xp->keep_cb())
+	{
+		const uint64_t now = xport_now_us();
+		if(xp->open_timeout_us > 0 && now >= deadline)
+		{
+			sock_printf(verbose, "[%s] no peer within %llu ms\n", __FUNCTION__, (unsigned long long)(xp->open_timeout_us / 1000));
+			break;
+		}
+		uint64_t slice_us = ms_to_us(SOCK_ACCEPT_SLICE);
+		if(xp->open_timeout_us > 0 && deadline - now < slice_us)
+		{
+			slice_us = deadline - now;
+		}
+		struct pollfd pfd = {.fd = lfd, .events = POLLIN, .revents = 0};
+		int pret = sock_poll(&pfd, 1, (int)((slice_us + 999) / 1000));
+		if(pret < 0 && !SOCK_EINTR(sock_errno()))
+		{
+			break;
+		}
+		if(pret > 0)
+		{
+			fd = accept(lfd, NULL, NULL);
+			break;
+		}
+	}
+	if(fd == SOCK_INVALID)
+	{
+		sock_printf(verbose, "[%s] errno = %d\n", __FUNCTION__, sock_errno());
+	}
+	else
+	{
+		sock_tune(fd, is_tcp, verbose);
+	}
+	sock_close(lfd);
+	return fd;
+}
+
+static int sock_xport_open(struct xport_t* xp, const char* name, unsigned long baud)
+{
+	bool is_tcp = (strncmp(name, SOCK_TCP_PREFIX, strlen(SOCK_TCP_PREFIX)) == 0)?(true):(false);
+	const char* p = name + strlen((is_tcp == true)?(SOCK_TCP_PREFIX):(SOCK_UNIX_PREFIX));
+	bool is_listen = false;
+	if(strncmp(p, SOCK_LISTEN_SUFFIX, strlen(SOCK_LISTEN_SUFFIX)) == 0)
+	{
+		is_listen = true;
+		p += strlen(SOCK_LISTEN_SUFFIX);
+	}
+	if(*p != ':')
+	{
+		sock_printf(xp->verbose, "[%s] bad name = %s\n", __FUNCTION__, name);
+		return -1;
+	}
+	p++;
+	if(sock_startup() != 0)
+	{
+		return -1;
+	}
+	sock_fd_t fd = SOCK_INVALID;
+	if(is_tcp == true)
+	{
+		fd = sock_tcp_open(p, is_listen, xp->verbose);
+	}
+#ifndef _WIN32
+	else
+	{
+		fd = sock_unix_open(p, is_listen, xp->verbose);
+	}
+#endif
+	if(fd != SOCK_INVALID && is_listen == true)
+	{
+		sock_printf(xp->verbose, "[%s] waiting for a peer on %s\n", __FUNCTION__, name);
+		fd = sock_accept(fd, is_tcp, xp);
+	}
+	if(fd == SOCK_INVALID || sock_nonblock(fd) != 0)
+	{
+		if(fd != SOCK_INVALID)
+		{
+			sock_close(fd);
+		}
+		sock_cleanup();
+		return -1;
+	}
+	xp->priv = (void*)(intptr_t)fd;
+	//NOTE: a terminal server paces the far end at its own baud, which is not visible here
+	xp->caps = XPORT_CAP_WAIT | XPORT_CAP_RELIABLE;
+	xp->baud = baud;
+	return 0;
+}
+
+static int sock_xport_read(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ)
+{
+	sock_fd_t fd = (sock_fd_t)(intptr_t)xp->priv;
+	int rret = (int)recv(fd, (char*)buf, BUF_SZ, 0);
+	if(rret < 0)
+	{
+		int e = sock_errno();
+		return (SOCK_EAGAIN(e) || SOCK_EINTR(e))?(0):(-1);
+	}
+	if(rret == 0)
+	{
+		return -1; //i.e. the peer has gone
+	}
+#ifdef TCP_QUICKACK
+	//i.e. Linux falls back to delayed ACK after a while, so it is re-armed on every read
+	int on = 1;
+	(void)setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, (const char*)&on, sizeof(on));
+#endif
+	return rret;
+}
+
+static int sock_write_wait(sock_fd_t fd, const uint64_t deadline_us, const bool verbose)
+{
+	//i.e. the send buffer is full, the write fails when the peer does not drain it by the deadline or a signal comes in between
+	const uint64_t now = xport_now_us();
+	if(now >= deadline_us)
+	{
+		sock_printf(verbose, "[%s] send buffer stays full\n", __FUNCTION__);
+		return -1;
+	}
+	struct pollfd pfd = {.fd = fd, .events = POLLOUT, .revents = 0};
+	int pret = sock_poll(&pfd, 1, (int)((deadline_us - now + 999) / 1000));
+	if(pret < 0 || (pret > 0 && (pfd.revents & (POLLERR | POLLNVAL)) != 0))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+static int sock_xport_write(struct xport_t* xp, const unsigned char* buf, const size_t BUF_SZ)
+{
+	sock_fd_t fd = (sock_fd_t)(intptr_t)xp->priv;
+	const uint64_t deadline = xport_now_us() + xp->tx_timeout_us;
+	size_t done = 0;
+	while(done < BUF_SZ)
+	{
+		int wret = (int)send(fd, (const char*)buf + done, BUF_SZ - done, SOCK_SEND_FLAGS);
+		if(wret < 0)
+		{
+			int e = sock_errno();
+			if(SOCK_EAGAIN(e))
+			{
+				if(sock_write_wait(fd, deadline, xp->verbose) != 0)
+				{
+					return -1;
+				}
+				continue;
+			}
+			if(SOCK_EINTR(e))
+			{
+				continue;
+			}
+			return -1;
+		}
+		done += (size_t)wret;
+	}
+	return (int)done;
+}
+
+#ifndef _WIN32
+static int sock_xport_writev(struct xport_t* xp, const struct xport_iov_t* iov, const int cnt)
+{
+	//i.e. one segment for a gathered frame, the same as a single write
+	sock_fd_t fd = (sock_fd_t)(intptr_t)xp->priv;
+	const uint64_t deadline = xport_now_us() + xp->tx_timeout_us;
+	struct iovec vec[8];
+	int n = 0;
+	size_t total = 0;
+	for(n = 0; n < cnt && n < (int)(sizeof(vec)/sizeof(vec[0])); n++)
+	{
+		vec[n].iov_base = (void*)iov[n].buf;
+		vec[n].iov_len = iov[n].len;
+		total += iov[n].len;
+	}
+	if(n < cnt)
+	{
+		return -1;
+	}
+	struct msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = vec;
+	msg.msg_iovlen = n;
+	size_t done = 0;
+	while(done < total)
+	{
+		ssize_t wret = sendmsg(fd, &msg, SOCK_SEND_FLAGS);
+		if(wret < 0)
+		{
+			int e = sock_errno();
+			if(SOCK_EAGAIN(e))
+			{
+				if(sock_write_wait(fd, deadline, xp->verbose) != 0)
+				{
+					return -1;
+				}
+				continue;
+			}
+			if(SOCK_EINTR(e))
+			{
+				continue;
+			}
+			return -1;
+		}
+		done += (size_t)wret;
+		while(msg.msg_iovlen > 0 && (size_t)wret >= msg.msg_iov->iov_len)
+		{
+			wret -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if(msg.msg_iovlen > 0)
+		{
+			msg.msg_iov->iov_base = (char*)msg.msg_iov->iov_base + wret;
+			msg.msg_iov->iov_len -= wret;
+		}
+	}
+	return (int)done;
+}
+#endif
+
+static int sock_xport_wait(struct xport_t* xp, const uint64_t timeout_us)
+{
+	sock_fd_t fd = (sock_fd_t)(intptr_t)xp->priv;
+	struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+	int pret = sock_poll(&pfd, 1, (int)((timeout_us + 999) / 1000));
+	if(pret < 0)
+	{
+		return SOCK_EINTR(sock_errno())?(0):(-1);
+	}
+	//i.e. POLLHUP is reported as readable, so the following read sees the end of stream
+	if(pret > 0 && (pfd.revents & (POLLERR | POLLNVAL)) != 0)
+	{
+		return -1;
+	}
+	return (pret > 0)?(1):(0);
+}
+
+static void sock_xport_close(struct xport_t* xp)
+{
+	sock_close((sock_fd_t)(intptr_t)xp->priv);
+	sock_cleanup();
+}
+
+const struct xport_ops_t sock_tcp_xport_ops =
+{
+	.name = "tcp",
+	.prefix = SOCK_TCP_PREFIX,
+	.open = sock_xport_open,
+	.read = sock_xport_read,
+	.write = sock_xport_write,
+#ifndef _WIN32
+	.writev = sock_xport_writev,
+#endif
+	.wait = sock_xport_wait,
+	.close = sock_xport_close,
+};
+
+const struct xport_ops_t sock_tcp_listen_xport_ops =
+{
+	.name = "tcp-listen",
+	.prefix = SOCK_TCP_LISTEN_PREFIX,
+	.open = sock_xport_open,
+	.read = sock_xport_read,
+	.write = sock_xport_write,
+#ifndef _WIN32
+	.writev = sock_xport_writev,
+#endif
+	.wait = sock_xport_wait,
+	.close = sock_xport_close,
+};
+
+#ifndef _WIN32
+const struct xport_ops_t sock_unix_xport_ops =
+{
+	.name = "unix",
+	.prefix = SOCK_UNIX_PREFIX,
+	.open = sock_xport_open,
+	.read = sock_xport_read,
+	.write = sock_xport_write,
+	.writev = sock_xport_writev,
+	.wait = sock_xport_wait,
+	.close = sock_xport_close,
+};
+
+const struct xport_ops_t sock_unix_listen_xport_ops =
+{
+	.name = "unix-listen",
+	.prefix = SOCK_UNIX_LISTEN_PREFIX,
+	.open = sock_xport_open,
+	.read = sock_xport_read,
+	.write = sock_xport_write,
+	.writev = sock_xport_writev,
+	.wait = sock_xport_wait,
+	.close = sock_xport_close,
+};
+#endif
@@ -1,16 +1,7 @@
-#include "sp.h"
-
-static BOOL verbose = FALSE;
-
-void sp_verb_clear(void)
-{
-	verbose = FALSE;
-}
+#include <stdlib.h>
+#include <string.h>
 
-void sp_verb_set(void)
-{
-	verbose = TRUE;
-}
+#include "sp.h"
 
 static BOOL query_device_description(HDEVINFO hDevInfoSet, SP_DEVINFO_DATA* devInfo, char* buf, const size_t BUF_SZ, size_t* nReturn)
 {
@@ -87,7 +78,7 @@ static BOOL query_registry_for_port_name(HKEY hKey, int* nPort)
 	return bAdded;
 }
 
-int sp_query(int** port_number_list, int* port_cnt)
+int sp_query(int** port_number_list, int* port_cnt, const BOOL verbose)
 {
 	//i.e. Device Manager manner
 	int ret = -1;
@@ -177,9 +168,9 @@ int sp_query(int** port_number_list, int* port_cnt)
 
 		ret = 0;
 	} while(0);
-	if(port_number_list != NULL && *port_number_list != NULL)
+	if(ret != 0 && list != NULL)
 	{
-		free(*port_number_list);
+		free(list);
 	}
 	return ret;
 }
@@ -245,15 +236,15 @@ void sp_close(HANDLE hComm)
 	(void)CloseHandle(hComm);
 }
 
-int sp_read(HANDLE hComm, unsigned char* buf, const size_t BUF_SZ)
+static int sp_read_ov(HANDLE hComm, HANDLE hEvent, unsigned char* buf, const size_t BUF_SZ)
 {
 	OVERLAPPED osReader = {0};
 	DWORD dwRead = 0;
 	BOOL fRes = FALSE;
 	do
 	{
-		osReader.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-		if (osReader.hEvent == NULL)
+		osReader.hEvent = hEvent;
+		if (osReader.hEvent == NULL || FALSE == ResetEvent(osReader.hEvent))
 		{
 			fRes = FALSE;
 			break;
@@ -315,23 +306,30 @@ int sp_read(HANDLE hComm, unsigned char* buf, const size_t BUF_SZ)
 			}
 		}
 	} while(0);
-	if (osReader.hEvent != NULL)
-	{
-		CloseHandle(osReader.hEvent);
-	}
 
 	return (fRes == TRUE)?(dwRead):(-1);
 }
 
-int sp_write(HANDLE hComm, unsigned char* buf, const size_t BUF_SZ)
+int sp_read(HANDLE hComm, unsigned char* buf, const size_t BUF_SZ)
+{
+	HANDLE hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	int ret = sp_read_ov(hComm, hEvent, buf, BUF_SZ);
+	if (hEvent != NULL)
+	{
+		CloseHandle(hEvent);
+	}
+	return ret;
+}
+
+static int sp_write_ov(HANDLE hComm, HANDLE hEvent, unsigned char* buf, const size_t BUF_SZ, const DWORD WRITE_TIMEOUT)
 {
 	OVERLAPPED osWrite = {0};
 	DWORD dwWritten = 0;
 	BOOL fRes = FALSE;
 	do
 	{
-		osWrite.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
-		if (osWrite.hEvent == NULL)
+		osWrite.hEvent = hEvent;
+		if (osWrite.hEvent == NULL || FALSE == ResetEvent(osWrite.hEvent))
 		{
 			fRes = FALSE;
 			break;
@@ -350,9 +348,18 @@ int sp_write(HANDLE hComm, unsigned char* buf, const size_t BUF_SZ)
 			}
 			else
 			{
-				DWORD dwRes = WaitForSingleObject(osWrite.hEvent, INFINITE);
+				//i.e. the same as a full tty, a line which does not drain by WRITE_TIMEOUT fails the write
+				DWORD dwRes = WaitForSingleObject(osWrite.hEvent, WRITE_TIMEOUT);
 				switch(dwRes)
 				{
+					case WAIT_TIMEOUT:
+					{
+						//NOTE: buf must outlive the request, so the cancelled write is waited for before returning
+						(void)CancelIo(hComm);
+						(void)GetOverlappedResult(hComm, &osWrite, &dwWritten, TRUE);
+						fRes = FALSE;
+					}
+					break;
 					case WAIT_OBJECT_0:
 					{
 						BOOL gret = GetOverlappedResult(hComm, &osWrite, &dwWritten, FALSE);
@@ -379,10 +386,192 @@ int sp_write(HANDLE hComm, unsigned char* buf, const size_t BUF_SZ)
 			fRes = TRUE;
 		}
 	} while(0);
-	if (osWrite.hEvent != NULL)
+
+	return (fRes == TRUE)?(dwWritten):(-1);
+}
+
+int sp_write(HANDLE hComm, unsigned char* buf, const size_t BUF_SZ)
+{
+	HANDLE hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	int ret = sp_write_ov(hComm, hEvent, buf, BUF_SZ, INFINITE);
+	if (hEvent != NULL)
 	{
-		CloseHandle(osWrite.hEvent);
+		CloseHandle(hEvent);
 	}
+	return ret;
+}
 
-	return (fRes == TRUE)?(dwWritten):(-1);
+struct sp_port_t
+{
+	HANDLE hComm;
+	HANDLE hReadEvent; //NOTE: events are created once per port rather than once per call
+	HANDLE hWriteEvent;
+	OVERLAPPED osWait;
+	DWORD dwEvtMask;
+	BOOL fWaitingOnEvent; //i.e. a WaitCommEvent is outstanding
+};
+
+static void sp_port_release(struct sp_port_t* port)
+{
+	if(port->fWaitingOnEvent == TRUE)
+	{
+		//i.e. a changed mask completes the outstanding WaitCommEvent
+		DWORD dwDummy = 0;
+		(void)SetCommMask(port->hComm, 0);
+		(void)GetOverlappedResult(port->hComm, &port->osWait, &dwDummy, TRUE);
+		port->fWaitingOnEvent = FALSE;
+	}
+	if(port->osWait.hEvent != NULL)
+	{
+		CloseHandle(port->osWait.hEvent);
+	}
+	if(port->hReadEvent != NULL)
+	{
+		CloseHandle(port->hReadEvent);
+	}
+	if(port->hWriteEvent != NULL)
+	{
+		CloseHandle(port->hWriteEvent);
+	}
+	if(port->hComm != INVALID_HANDLE_VALUE)
+	{
+		sp_close(port->hComm);
+	}
+	free(port);
+}
+
+static int sp_xport_open(struct xport_t* xp, const char* name, unsigned long baud)
+{
+	//i.e. "COM6" or "\\\\.\\COM6", nothing else names a port
+	const char* DEV_PREFIX = "\\\\.\\";
+	const char* p = (strncmp(name, DEV_PREFIX, strlen(DEV_PREFIX)) == 0)?(name + strlen(DEV_PREFIX)):(name);
+	if(_strnicmp(p, "COM", 3) != 0 || p[3] < '1' || p[3] > '9')
+	{
+		return -1;
+	}
+	char* end = NULL;
+	unsigned long port_number = strtoul(p + 3, &end, 10);
+	if(*end != '\0' || port_number > 255)
+	{
+		return -1;
+	}
+	struct sp_port_t* port = (struct sp_port_t*)calloc(1, sizeof(struct sp_port_t));
+	if(port == NULL)
+	{
+		return -1;
+	}
+	port->hComm = sp_open((int)port_number, (unsigned int)baud);
+	port->hReadEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	port->hWriteEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	port->osWait.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(port->hComm == INVALID_HANDLE_VALUE || port->hReadEvent == NULL || port->hWriteEvent == NULL || port->osWait.hEvent == NULL)
+	{
+		sp_port_release(port);
+		return -1;
+	}
+	xp->priv = (void*)port;
+	xp->caps = XPORT_CAP_BAUD | XPORT_CAP_WAIT;
+	xp->baud = (baud == 0)?(CBR_115200):(baud);
+	return 0;
+}
+
+static int sp_xport_read(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ)
+{
+	struct sp_port_t* port = (struct sp_port_t*)xp->priv;
+	return sp_read_ov(port->hComm, port->hReadEvent, buf, BUF_SZ);
+}
+
+static int sp_xport_write(struct xport_t* xp, const unsigned char* buf, const size_t BUF_SZ)
+{
+	struct sp_port_t* port = (struct sp_port_t*)xp->priv;
+	const uint64_t timeout_ms = (xp->tx_timeout_us + 999) / 1000;
+	return sp_write_ov(port->hComm, port->hWriteEvent, (unsigned char*)buf, BUF_SZ, (timeout_ms < (uint64_t)INFINITE)?((DWORD)timeout_ms):(INFINITE - 1));
+}
+
+static int sp_xport_in_queue(struct sp_port_t* port)
+{
+	COMSTAT comStat = {0};
+	DWORD dwErrors = 0;
+	if (FALSE == ClearCommError(port->hComm, &dwErrors, &comStat))
+	{
+		return -1;
+	}
+	return (comStat.cbInQue > 0)?(1):(0);
+}
+
+static int sp_xport_wait(struct xport_t* xp, const uint64_t timeout_us)
+{
+	//i.e. EV_RXCHAR is armed by sp_open, so WaitCommEvent wakes up on the first incoming byte
+	struct sp_port_t* port = (struct sp_port_t*)xp->priv;
+	int ret = sp_xport_in_queue(port);
+	if(ret != 0)
+	{
+		return ret;
+	}
+	if(port->fWaitingOnEvent == FALSE)
+	{
+		HANDLE hEvent = port->osWait.hEvent;
+		memset(&port->osWait, 0, sizeof(port->osWait));
+		port->osWait.hEvent = hEvent;
+		(void)ResetEvent(hEvent);
+		if(TRUE == WaitCommEvent(port->hComm, &port->dwEvtMask, &port->osWait))
+		{
+			return sp_xport_in_queue(port);
+		}
+		if (GetLastError() != ERROR_IO_PENDING)
+		{
+			return -1;
+		}
+		port->fWaitingOnEvent = TRUE;
+		//NOTE: a byte may have landed between ClearCommError and WaitCommEvent
+		ret = sp_xport_in_queue(port);
+		if(ret != 0)
+		{
+			return ret;
+		}
+	}
+	DWORD dwTimeout = (DWORD)((timeout_us + 999) / 1000);
+	DWORD dwRes = WaitForSingleObject(port->osWait.hEvent, dwTimeout);
+	switch(dwRes)
+	{
+		case WAIT_OBJECT_0:
+		{
+			DWORD dwDummy = 0;
+			port->fWaitingOnEvent = FALSE;
+			if (FALSE == GetOverlappedResult(port->hComm, &port->osWait, &dwDummy, FALSE))
+			{
+				return -1;
+			}
+			ret = sp_xport_in_queue(port);
+		}
+		break;
+		case WAIT_TIMEOUT:
+		{
+			//i.e. the outstanding WaitCommEvent is reused by the next call
+			ret = 0;
+		}
+		break;
+		default:
+		{
+			ret = -1;
+		}
+		break;
+	}
+	return ret;
+}
+
+static void sp_xport_close(struct xport_t* xp)
+{
+	sp_port_release((struct sp_port_t*)xp->priv);
 }
+
+const struct xport_ops_t sp_xport_ops =
+{
+	.name = "sp",
+	.prefix = NULL,
+	.open = sp_xport_open,
+	.read = sp_xport_read,
+	.write = sp_xport_write,
+	.wait = sp_xport_wait,
+	.close = sp_xport_close,
+};
@@ -0,0 +1,603 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "stream.h"
+
+#define stream_printf(verbose, fmt, ...) \
+	do { if((verbose) == true) printf(fmt, __VA_ARGS__); } while(0)
+
+struct stream_chunk_t
+{
+	uint8_t* data;
+	size_t len;
+};
+
+static void stream_chunk_bind(struct stream_chunk_t* chunk, void* slab)
+{
+	//i.e. the chunks follow the state in the same slab, so a stream costs one allocation and one free
+	uint8_t* data = (uint8_t*)slab;
+	int k = 0;
+	for(k = 0; k < STREAM_CHUNK_CNT; k++)
+	{
+		chunk[k].data = &data[k * STREAM_CHUNK_SZ];
+		chunk[k].len = 0;
+	}
+}
+
+struct stream_src_t
+{
+	FILE* fp;
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct stream_chunk_t chunk[STREAM_CHUNK_CNT];
+	int head;    //i.e. the chunk being consumed
+	int cnt;     //i.e. chunks filled by the reader and not consumed yet
+	size_t pos;  //i.e. read position within chunk[head]
+	bool is_eof; //i.e. the reader is done, either at the end of the file or on error
+	bool is_err;
+	bool is_stop;
+	bool verbose;
+	unsigned long long fills;
+};
+
+static void* stream_src_thread(void* arg)
+{
+	//i.e. keep up to STREAM_CHUNK_CNT chunks read ahead of the transmitter
+	struct stream_src_t* src = (struct stream_src_t*)arg;
+	while(true)
+	{
+		pthread_mutex_lock(&src->lock);
+		while(src->cnt == STREAM_CHUNK_CNT && src->is_stop == false)
+		{
+			pthread_cond_wait(&src->cond, &src->lock);
+		}
+		if(src->is_stop == true)
+		{
+			pthread_mutex_unlock(&src->lock);
+			break;
+		}
+		struct stream_chunk_t* chunk = &src->chunk[(src->head + src->cnt) % STREAM_CHUNK_CNT];
+		pthread_mutex_unlock(&src->lock);
+
+		//NOTE: the consumer never touches a chunk beyond cnt, so it is filled without the lock
+		size_t rret = fread(chunk->data, sizeof(uint8_t), STREAM_CHUNK_SZ, src->fp);
+
+		pthread_mutex_lock(&src->lock);
+		chunk->len = rret;
+		src->cnt++;
+		src->fills++;
+		if(rret < STREAM_CHUNK_SZ)
+		{
+			src->is_err = (ferror(src->fp) != 0)?(true):(false);
+			src->is_eof = true;
+		}
+		pthread_cond_broadcast(&src->cond);
+		bool is_done = src->is_eof;
+		pthread_mutex_unlock(&src->lock);
+		if(is_done == true)
+		{
+			break;
+		}
+	}
+	return NULL;
+}
+
+struct stream_src_t* stream_src_open(const char* fn, const bool verbose)
+{
+	return stream_src_open_at(fn, 0, verbose);
+}
+
+struct stream_src_t* stream_src_open_at(const char* fn, const uint64_t offset, const bool verbose)
+{
+	struct stream_src_t* src = (struct stream_src_t*)calloc(1, sizeof(struct stream_src_t) + STREAM_CHUNK_CNT * STREAM_CHUNK_SZ);
+	if(src == NULL)
+	{
+		return NULL;
+	}
+	stream_chunk_bind(src->chunk, src + 1);
+	src->verbose = verbose;
+	do
+	{
+		src->fp = fopen(fn, "rb");
+		if(src->fp == NULL)
+		{
+			stream_printf(verbose, "[%s] fn = %s, error!\n", __FUNCTION__, fn);
+			break;
+		}
+#ifdef _WIN32
+		int sret = _fseeki64(src->fp, (__int64)offset, SEEK_SET);
+#else
+		int sret = fseeko(src->fp, (off_t)offset, SEEK_SET);
+#endif
+		if(sret != 0)
+		{
+			stream_printf(verbose, "[%s] fn = %s, offset = %llu, error!\n", __FUNCTION__, fn, (unsigned long long)offset);
+			break;
+		}
+		pthread_mutex_init(&src->lock, NULL);
+		pthread_cond_init(&src->cond, NULL);
+		//i.e. reading starts at once, so the first block is ready by the time the receiver asks for it
+		if(pthread_create(&src->tid, NULL, stream_src_thread, src) != 0)
+		{
+			pthread_cond_destroy(&src->cond);
+			pthread_mutex_destroy(&src->lock);
+			break;
+		}
+		return src;
+	} while(0);
+	if(src->fp != NULL)
+	{
+		fclose(src->fp);
+	}
+	free(src);
+	return NULL;
+}
+
+int stream_src_read(struct stream_src_t* src, uint8_t* buf, const size_t BUF_SZ)
+{
+	//i.e. fill buf completely unless the file ends, 0 means the end, -1 means a read error
+	size_t done = 0;
+	while(done < BUF_SZ)
+	{
+		pthread_mutex_lock(&src->lock);
+		while(src->cnt == 0 && src->is_eof == false)
+		{
+			pthread_cond_wait(&src->cond, &src->lock);
+		}
+		if(src->cnt == 0)
+		{
+			bool is_err = src->is_err;
+			pthread_mutex_unlock(&src->lock);
+			if(is_err == true)
+			{
+				return -1;
+			}
+			break;
+		}
+		struct stream_chunk_t* chunk = &src->chunk[src->head];
+		pthread_mutex_unlock(&src->lock);
+
+		size_t cnt = chunk->len - src->pos;
+		if(cnt > BUF_SZ - done)
+		{
+			cnt = BUF_SZ - done;
+		}
+		memcpy(&buf[done], &chunk->data[src->pos], cnt);
+		done += cnt;
+		src->pos += cnt;
+		if(src->pos == chunk->len)
+		{
+			pthread_mutex_lock(&src->lock);
+			src->head = (src->head + 1) % STREAM_CHUNK_CNT;
+			src->cnt--;
+			src->pos = 0;
+			pthread_cond_broadcast(&src->cond);
+			pthread_mutex_unlock(&src->lock);
+		}
+	}
+	return (int)done;
+}
+
+void stream_src_close(struct stream_src_t* src)
+{
+	if(src == NULL)
+	{
+		return;
+	}
+	pthread_mutex_lock(&src->lock);
+	src->is_stop = true;
+	pthread_cond_broadcast(&src->cond);
+	pthread_mutex_unlock(&src->lock);
+	pthread_join(src->tid, NULL);
+	stream_printf(src->verbose, "[%s] fills = %llu\n", __FUNCTION__, src->fills);
+	pthread_cond_destroy(&src->cond);
+	pthread_mutex_destroy(&src->lock);
+	fclose(src->fp);
+	free(src);
+}
+
+struct stream_snk_t
+{
+	FILE* fp;
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct stream_chunk_t chunk[STREAM_CHUNK_CNT];
+	int head;   //i.e. the chunk being written to the file
+	int cnt;    //i.e. chunks handed to the writer and not written yet
+	int fill;   //i.e. the chunk being filled by the receiver
+	bool is_err;
+	bool is_halted; //i.e. of the receiver alone, a handoff failed and no chunk is filled after it
+	bool is_stop;
+	bool verbose;
+	unsigned long long writes;
+};
+
+static void* stream_snk_thread(void* arg)
+{
+	//i.e. disk latency is taken here, so it never delays an ACK unless all chunks are full
+	struct stream_snk_t* snk = (struct stream_snk_t*)arg;
+	while(true)
+	{
+		pthread_mutex_lock(&snk->lock);
+		while(snk->cnt == 0 && snk->is_stop == false)
+		{
+			pthread_cond_wait(&snk->cond, &snk->lock);
+		}
+		if(snk->cnt == 0)
+		{
+			pthread_mutex_unlock(&snk->lock);
+			break;
+		}
+		struct stream_chunk_t* chunk = &snk->chunk[snk->head];
+		pthread_mutex_unlock(&snk->lock);
+
+		size_t wret = fwrite(chunk->data, sizeof(uint8_t), chunk->len, snk->fp);
+
+		pthread_mutex_lock(&snk->lock);
+		if(wret != chunk->len)
+		{
+			snk->is_err = true;
+		}
+		chunk->len = 0;
+		snk->head = (snk->head + 1) % STREAM_CHUNK_CNT;
+		snk->cnt--;
+		snk->writes++;
+		pthread_cond_broadcast(&snk->cond);
+		pthread_mutex_unlock(&snk->lock);
+	}
+	return NULL;
+}
+
+static FILE* stream_snk_fopen_at(const char* fn, const uint64_t offset)
+{
+	//i.e. the file is cut at offset, so bytes written after it (and never confirmed) are dropped
+	FILE* fp = fopen(fn, "rb+");
+	if(fp == NULL)
+	{
+		return NULL;
+	}
+#ifdef _WIN32
+	int tret = _chsize_s(_fileno(fp), (__int64)offset);
+	int sret = _fseeki64(fp, 0, SEEK_END);
+#else
+	int tret = ftruncate(fileno(fp), (off_t)offset);
+	int sret = fseeko(fp, 0, SEEK_END);
+#endif
+	if(tret != 0 || sret != 0)
+	{
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+static FILE* stream_snk_fopen_in(const char* fn, const uint64_t offset)
+{
+	//i.e. the file is created when it is missing, but never cut, as other writers may fill the rest of it
+#ifdef _WIN32
+	int fd = _open(fn, _O_RDWR | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+	FILE* fp = (fd < 0)?(NULL):(_fdopen(fd, "rb+"));
+#else
+	int fd = open(fn, O_RDWR | O_CREAT, 0666);
+	FILE* fp = (fd < 0)?(NULL):(fdopen(fd, "rb+"));
+#endif
+	if(fp == NULL)
+	{
+		if(fd >= 0)
+		{
+#ifdef _WIN32
+			_close(fd);
+#else
+			close(fd);
+#endif
+		}
+		return NULL;
+	}
+#ifdef _WIN32
+	int sret = _fseeki64(fp, (__int64)offset, SEEK_SET);
+#else
+	int sret = fseeko(fp, (off_t)offset, SEEK_SET);
+#endif
+	if(sret != 0)
+	{
+		fclose(fp);
+		return NULL;
+	}
+	return fp;
+}
+
+static struct stream_snk_t* stream_snk_start(const char* fn, const uint64_t offset, const bool is_shared, const bool verbose)
+{
+	struct stream_snk_t* snk = (struct stream_snk_t*)calloc(1, sizeof(struct stream_snk_t) + STREAM_CHUNK_CNT * STREAM_CHUNK_SZ);
+	if(snk == NULL)
+	{
+		return NULL;
+	}
+	stream_chunk_bind(snk->chunk, snk + 1);
+	snk->verbose = verbose;
+	do
+	{
+		if(is_shared == true)
+		{
+			snk->fp = stream_snk_fopen_in(fn, offset);
+		}
+		else
+		{
+			snk->fp = (offset == 0)?(fopen(fn, "wb+")):(stream_snk_fopen_at(fn, offset));
+		}
+		if(snk->fp == NULL)
+		{
+			stream_printf(verbose, "[%s] fn = %s, offset = %llu, error!\n", __FUNCTION__, fn, (unsigned long long)offset);
+			break;
+		}
+		pthread_mutex_init(&snk->lock, NULL);
+		pthread_cond_init(&snk->cond, NULL);
+		if(pthread_create(&snk->tid, NULL, stream_snk_thread, snk) != 0)
+		{
+			pthread_cond_destroy(&snk->cond);
+			pthread_mutex_destroy(&snk->lock);
+			break;
+		}
+		return snk;
+	} while(0);
+	if(snk->fp != NULL)
+	{
+		fclose(snk->fp);
+	}
+	free(snk);
+	return NULL;
+}
+
+struct stream_snk_t* stream_snk_open(const char* fn, const bool verbose)
+{
+	return stream_snk_start(fn, 0, false, verbose);
+}
+
+struct stream_snk_t* stream_snk_open_at(const char* fn, const uint64_t offset, const bool verbose)
+{
+	return stream_snk_start(fn, offset, false, verbose);
+}
+
+struct stream_snk_t* stream_snk_open_in(const char* fn, const uint64_t offset, const bool verbose)
+{
+	return stream_snk_start(fn, offset, true, verbose);
+}
+
+static int stream_snk_handoff(struct stream_snk_t* snk)
+{
+	//i.e. queue the chunk being filled for the writer, then wait for a free one
+	//NOTE: nothing is queued once the writer has failed, so cnt never goes past STREAM_CHUNK_CNT
+	pthread_mutex_lock(&snk->lock);
+	if(snk->is_err == true)
+	{
+		pthread_mutex_unlock(&snk->lock);
+		snk->is_halted = true;
+		return -1;
+	}
+	snk->cnt++;
+	snk->fill = (snk->fill + 1) % STREAM_CHUNK_CNT;
+	pthread_cond_broadcast(&snk->cond);
+	while(snk->cnt == STREAM_CHUNK_CNT && snk->is_err == false)
+	{
+		pthread_cond_wait(&snk->cond, &snk->lock);
+	}
+	bool is_err = snk->is_err;
+	pthread_mutex_unlock(&snk->lock);
+	snk->is_halted = is_err; //i.e. chunk[fill] may still be queued for the writer then
+	return (is_err == true)?(-1):(0);
+}
+
+int stream_snk_write(struct stream_snk_t* snk, const uint8_t* buf, const size_t BUF_SZ)
+{
+	//i.e. blocks are coalesced into chunks, so the file sees large sequential writes
+	if(snk->is_halted == true)
+	{
+		return -1;
+	}
+	size_t done = 0;
+	while(done < BUF_SZ)
+	{
+		struct stream_chunk_t* chunk = &snk->chunk[snk->fill];
+		size_t cnt = STREAM_CHUNK_SZ - chunk->len;
+		if(cnt > BUF_SZ - done)
+		{
+			cnt = BUF_SZ - done;
+		}
+		memcpy(&chunk->data[chunk->len], &buf[done], cnt);
+		chunk->len += cnt;
+		done += cnt;
+		if(chunk->len == STREAM_CHUNK_SZ && stream_snk_handoff(snk) != 0)
+		{
+			return -1;
+		}
+	}
+	return (int)done;
+}
+
+int stream_snk_close(struct stream_snk_t* snk)
+{
+	//i.e. flush what is left, 0 means every byte reached the file
+	if(snk == NULL)
+	{
+		return -1;
+	}
+	if(snk->chunk[snk->fill].len > 0 && snk->is_halted == false)
+	{
+		(void)stream_snk_handoff(snk);
+	}
+	pthread_mutex_lock(&snk->lock);
+	snk->is_stop = true;
+	pthread_cond_broadcast(&snk->cond);
+	pthread_mutex_unlock(&snk->lock);
+	pthread_join(snk->tid, NULL);
+	stream_printf(snk->verbose, "[%s] writes = %llu\n", __FUNCTION__, snk->writes);
+	bool is_err = snk->is_err;
+	if(fflush(snk->fp) != 0)
+	{
+		is_err = true;
+	}
+	if(fclose(snk->fp) != 0)
+	{
+		is_err = true;
+	}
+	pthread_cond_destroy(&snk->cond);
+	pthread_mutex_destroy(&snk->lock);
+	free(snk);
+	return (is_err == true)?(-1):(0);
+}
+
+struct stream_map_t
+{
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#endif
+	const uint8_t* base; //i.e. NULL for an empty file, nothing can be mapped then
+	size_t size;
+	size_t pos;
+};
+
+struct stream_map_t* stream_map_open(const char* fn, const bool verbose)
+{
+	//i.e. the whole file is mapped read-only, so frames can be built straight from the page cache
+	struct stream_map_t* map = (struct stream_map_t*)calloc(1, sizeof(struct stream_map_t));
+	if(map == NULL)
+	{
+		return NULL;
+	}
+#ifdef _WIN32
+	do
+	{
+		map->file = CreateFileA(fn, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if(map->file == INVALID_HANDLE_VALUE)
+		{
+			break;
+		}
+		LARGE_INTEGER size;
+		if(GetFileSizeEx(map->file, &size) == 0 || (unsigned long long)size.QuadPart > (unsigned long long)SIZE_MAX)
+		{
+			break;
+		}
+		map->size = (size_t)size.QuadPart;
+		if(map->size > 0)
+		{
+			map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if(map->mapping == NULL)
+			{
+				break;
+			}
+			map->base = (const uint8_t*)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+			if(map->base == NULL)
+			{
+				break;
+			}
+		}
+		stream_printf(verbose, "[%s] fn = %s, size = %llu\n", __FUNCTION__, fn, (unsigned long long)map->size);
+		return map;
+	} while(0);
+	stream_printf(verbose, "[%s] fn = %s, error!\n", __FUNCTION__, fn);
+	if(map->mapping != NULL)
+	{
+		CloseHandle(map->mapping);
+	}
+	if(map->file != INVALID_HANDLE_VALUE && map->file != NULL)
+	{
+		CloseHandle(map->file);
+	}
+#else
+	int fd = open(fn, O_RDONLY);
+	do
+	{
+		if(fd < 0)
+		{
+			break;
+		}
+		struct stat st;
+		if(fstat(fd, &st) != 0 || S_ISREG(st.st_mode) == 0)
+		{
+			break;
+		}
+		map->size = (size_t)st.st_size;
+		if(map->size > 0)
+		{
+			void* base = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(base == MAP_FAILED)
+			{
+				break;
+			}
+			(void)madvise(base, map->size, MADV_SEQUENTIAL);
+			map->base = (const uint8_t*)base;
+		}
+		//NOTE: the mapping holds its own reference to the file
+		close(fd);
+		stream_printf(verbose, "[%s] fn = %s, size = %llu\n", __FUNCTION__, fn, (unsigned long long)map->size);
+		return map;
+	} while(0);
+	stream_printf(verbose, "[%s] fn = %s, error!\n", __FUNCTION__, fn);
+	if(fd >= 0)
+	{
+		close(fd);
+	}
+#endif
+	free(map);
+	return NULL;
+}
+
+size_t stream_map_next(struct stream_map_t* map, const uint8_t** data, const size_t BUF_SZ)
+{
+	//i.e. point at the next BUF_SZ bytes of the mapping, less only for the last piece, 0 means the end
+	size_t cnt = map->size - map->pos;
+	if(cnt > BUF_SZ)
+	{
+		cnt = BUF_SZ;
+	}
+	*data = (cnt > 0)?(&map->base[map->pos]):(NULL);
+	map->pos += cnt;
+	return cnt;
+}
+
+void stream_map_seek(struct stream_map_t* map, const uint64_t offset)
+{
+	map->pos = (offset < (uint64_t)map->size)?((size_t)offset):(map->size);
+}
+
+void stream_map_close(struct stream_map_t* map)
+{
+	if(map == NULL)
+	{
+		return;
+	}
+#ifdef _WIN32
+	if(map->base != NULL)
+	{
+		UnmapViewOfFile(map->base);
+	}
+	if(map->mapping != NULL)
+	{
+		CloseHandle(map->mapping);
+	}
+	CloseHandle(map->file);
+#else
+	if(map->base != NULL)
+	{
+		munmap((void*)map->base, map->size);
+	}
+#endif
+	free(map);
+}
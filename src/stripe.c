@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "stripe.h"
+#include "stream.h"
+
+#define stripe_printf(verbose, fmt, ...) \
+	do { if((verbose) == true) printf(fmt, __VA_ARGS__); } while(0)
+
+struct stripe_link_t
+{
+	struct xmodem_session_t* xs;
+	struct xmodem_stripe_t seg;
+	const char* fn; //i.e. the file to send, or the directory to receive into
+	bool xmodem_1k;
+	int xret;
+};
+
+static void* stripe_xmt_thread(void* arg)
+{
+	struct stripe_link_t* link = (struct stripe_link_t*)arg;
+	link->xret = xmodem_transmit_stripe(link->xs, link->fn, &link->seg, link->xmodem_1k);
+	return NULL;
+}
+
+static void* stripe_rcv_thread(void* arg)
+{
+	struct stripe_link_t* link = (struct stripe_link_t*)arg;
+	link->xret = xmodem_receive_stripe(link->xs, link->fn, &link->seg);
+	return NULL;
+}
+
+static int stripe_run(struct stripe_link_t* links, const int link_cnt, void* (*thread)(void*))
+{
+	//i.e. one thread per link, and every started one is joined before the result is known
+	pthread_t tid[STRIPE_LINK_MAX];
+	int started = 0;
+	int rret = 0;
+	while(started < link_cnt)
+	{
+		if(pthread_create(&tid[started], NULL, thread, &links[started]) != 0)
+		{
+			stripe_printf(links[0].xs->verbose, "[%s] link = %d, fail to create thread!\n", __FUNCTION__, started);
+			rret = -1;
+			break;
+		}
+		started++;
+	}
+	int k = 0;
+	for(k = 0; k < started; k++)
+	{
+		pthread_join(tid[k], NULL);
+		stripe_printf(links[0].xs->verbose, "[%s] link = %d, segment = %u, xret = %d\n", __FUNCTION__, k, (unsigned int)links[k].seg.idx, links[k].xret);
+		if(links[k].xret != 0)
+		{
+			rret = -1;
+		}
+	}
+	return rret;
+}
+
+int stripe_transmit(struct xmodem_session_t* xs, const int link_cnt, const char* fn, const bool xmodem_1k)
+{
+	//i.e. the file is cut into link_cnt contiguous segments, the last one takes what is left
+	struct stat st;
+	if(link_cnt < 1 || link_cnt > STRIPE_LINK_MAX || fn == NULL || stat(fn, &st) != 0)
+	{
+		return -1;
+	}
+	const uint64_t size = (uint64_t)st.st_size;
+	uint64_t seg_len = (size + (uint64_t)link_cnt - 1) / (uint64_t)link_cnt;
+	seg_len = (seg_len + STRIPE_ALIGN - 1) / STRIPE_ALIGN * STRIPE_ALIGN;
+	struct stripe_link_t links[STRIPE_LINK_MAX];
+	memset(links, 0, sizeof(links));
+	uint64_t offset = 0;
+	int k = 0;
+	for(k = 0; k < link_cnt; k++)
+	{
+		//NOTE: a file smaller than the links can carry leaves the last segments empty, they are sent all the same
+		links[k].xs = &xs[k];
+		links[k].fn = fn;
+		links[k].xmodem_1k = xmodem_1k;
+		links[k].xret = -1;
+		links[k].seg.idx = (unsigned short)k;
+		links[k].seg.cnt = (unsigned short)link_cnt;
+		links[k].seg.offset = offset;
+		links[k].seg.len = (size - offset < seg_len)?(size - offset):(seg_len);
+		links[k].seg.size = size;
+		offset += links[k].seg.len;
+		stripe_printf(xs[0].verbose, "[%s] link = %d, offset = %llu, len = %llu\n", __FUNCTION__, k, (unsigned long long)links[k].seg.offset, (unsigned long long)links[k].seg.len);
+	}
+	return stripe_run(links, link_cnt, stripe_xmt_thread);
+}
+
+static int stripe_check(const struct stripe_link_t* links, const int link_cnt)
+{
+	//i.e. block 0 of each link named its segment, together they have to cover one file exactly once
+	const struct xmodem_stripe_t* first = &links[0].seg;
+	const struct xmodem_stripe_t* order[STRIPE_LINK_MAX] = {NULL};
+	int k = 0;
+	for(k = 0; k < link_cnt; k++)
+	{
+		const struct xmodem_stripe_t* seg = &links[k].seg;
+		if(seg->cnt != (unsigned short)link_cnt || seg->size != first->size || strcmp(seg->path, first->path) != 0 || order[seg->idx] != NULL)
+		{
+			stripe_printf(links[0].xs->verbose, "[%s] link = %d, segment = %u of %u, fn = %s, does not belong!\n", __FUNCTION__, k, (unsigned int)seg->idx, (unsigned int)seg->cnt, seg->path);
+			return -1;
+		}
+		order[seg->idx] = seg;
+	}
+	uint64_t end = 0;
+	for(k = 0; k < link_cnt; k++)
+	{
+		if(order[k]->offset != end)
+		{
+			stripe_printf(links[0].xs->verbose, "[%s] segment = %d, offset = %llu, a gap or an overlap at %llu!\n", __FUNCTION__, k, (unsigned long long)order[k]->offset, (unsigned long long)end);
+			return -1;
+		}
+		end += order[k]->len;
+	}
+	return (end == first->size)?(0):(-1);
+}
+
+int stripe_receive(struct xmodem_session_t* xs, const int link_cnt, const char* dir, struct xmodem_stripe_t* stripe)
+{
+	//i.e. each link writes its segment in place, so the file is whole once the segments check out
+	memset(stripe, 0, sizeof(struct xmodem_stripe_t));
+	if(link_cnt < 1 || link_cnt > STRIPE_LINK_MAX)
+	{
+		return -1;
+	}
+	struct stripe_link_t links[STRIPE_LINK_MAX];
+	memset(links, 0, sizeof(links));
+	int k = 0;
+	for(k = 0; k < link_cnt; k++)
+	{
+		links[k].xs = &xs[k];
+		links[k].fn = dir;
+		links[k].xret = -1;
+	}
+	if(stripe_run(links, link_cnt, stripe_rcv_thread) != 0 || stripe_check(links, link_cnt) != 0)
+	{
+		return -1;
+	}
+	*stripe = links[0].seg;
+	stripe->idx = 0;
+	stripe->offset = 0;
+	stripe->len = stripe->size;
+	//NOTE: a longer file which was there before keeps its tail, so it is cut at the size of the one received
+	struct stat st;
+	if(stat(stripe->path, &st) != 0)
+	{
+		return -1;
+	}
+	if((uint64_t)st.st_size > stripe->size)
+	{
+		struct stream_snk_t* snk = stream_snk_open_at(stripe->path, stripe->size, xs[0].verbose);
+		if(snk == NULL || stream_snk_close(snk) != 0)
+		{
+			return -1;
+		}
+	}
+	stripe_printf(xs[0].verbose, "[%s] fn = %s, size = %llu, segments = %d\n", __FUNCTION__, stripe->path, (unsigned long long)stripe->size, link_cnt);
+	return 0;
+}
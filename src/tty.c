@@ -0,0 +1,621 @@
+#define _GNU_SOURCE //i.e. ppoll
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+
+#include "tty.h"
+
+#define tty_printf(verbose, fmt, ...) \
+	do { if((verbose) == true) printf(fmt, __VA_ARGS__); } while(0)
+
+struct tty_baud_t
+{
+	unsigned long baud;
+	speed_t speed;
+};
+
+static const struct tty_baud_t tty_bauds[] =
+{
+	{1200, B1200},
+	{2400, B2400},
+	{4800, B4800},
+	{9600, B9600},
+	{19200, B19200},
+	{38400, B38400},
+	{57600, B57600},
+	{115200, B115200},
+	{230400, B230400},
+#ifdef B460800
+	{460800, B460800},
+#endif
+#ifdef B921600
+	{921600, B921600},
+#endif
+#ifdef B1000000
+	{1000000, B1000000},
+#endif
+#ifdef B1500000
+	{1500000, B1500000},
+#endif
+#ifdef B2000000
+	{2000000, B2000000},
+#endif
+#ifdef B3000000
+	{3000000, B3000000},
+#endif
+#ifdef B4000000
+	{4000000, B4000000},
+#endif
+};
+
+static int tty_speed(unsigned long baud, speed_t* speed)
+{
+	size_t k = 0;
+	for(k = 0; k < sizeof(tty_bauds)/sizeof(tty_bauds[0]); k++)
+	{
+		if(tty_bauds[k].baud == baud)
+		{
+			*speed = tty_bauds[k].speed;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static bool tty_is_present(const char* path)
+{
+	//i.e. ttyS* nodes exist whether or not a UART is behind them
+	bool present = true;
+#if defined(__linux__) && defined(TIOCGSERIAL)
+	if(strncmp(path, "/dev/ttyS", 9) == 0)
+	{
+		int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+		struct serial_struct ss;
+		memset(&ss, 0, sizeof(ss));
+		if(fd < 0 || ioctl(fd, TIOCGSERIAL, &ss) != 0 || ss.type == PORT_UNKNOWN)
+		{
+			present = false;
+		}
+		if(fd >= 0)
+		{
+			close(fd);
+		}
+	}
+#endif
+	return present;
+}
+
+static int tty_name_compare(const void* a, const void* b)
+{
+	return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+int tty_query(char*** name_list, int* cnt, const bool verbose)
+{
+	static const char* prefixes[] = {"ttyS", "ttyUSB", "ttyACM", "ttyAMA", "cu."};
+	int ret = -1;
+	char** list = NULL;
+	int n = 0;
+	DIR* dir = NULL;
+	do
+	{
+		if(name_list == NULL || cnt == NULL)
+		{
+			break;
+		}
+		dir = opendir("/dev");
+		if(dir == NULL)
+		{
+			break;
+		}
+		struct dirent* ent = NULL;
+		bool err = false;
+		while((ent = readdir(dir)) != NULL)
+		{
+			size_t k = 0;
+			for(k = 0; k < sizeof(prefixes)/sizeof(prefixes[0]); k++)
+			{
+				if(strncmp(ent->d_name, prefixes[k], strlen(prefixes[k])) == 0)
+				{
+					break;
+				}
+			}
+			if(k == sizeof(prefixes)/sizeof(prefixes[0]))
+			{
+				continue;
+			}
+			char path[280] = {'\0'};
+			snprintf(path, sizeof(path), "/dev/%s", ent->d_name);
+			if(!tty_is_present(path))
+			{
+				continue;
+			}
+			tty_printf(verbose, "path = %s\n", path);
+			char** temp = (char**)realloc(list, sizeof(char*) * (n + 1));
+			if(temp == NULL)
+			{
+				err = true;
+				break;
+			}
+			list = temp;
+			list[n] = strdup(path);
+			if(list[n] == NULL)
+			{
+				err = true;
+				break;
+			}
+			n++;
+		}
+		if(err == true)
+		{
+			break;
+		}
+		if(n > 1)
+		{
+			qsort(list, n, sizeof(char*), tty_name_compare);
+		}
+		*name_list = list;
+		*cnt = n;
+		list = NULL;
+		ret = 0;
+	} while(0);
+	if(dir != NULL)
+	{
+		closedir(dir);
+	}
+	if(list != NULL)
+	{
+		int k = 0;
+		for(k = 0; k < n; k++)
+		{
+			free(list[k]);
+		}
+		free(list);
+	}
+	return ret;
+}
+
+int tty_raw(int fd, unsigned long baud, const bool verbose)
+{
+	//i.e. the same as DCB in sp_open: 8N1, no flow control, no line discipline
+	struct termios tio;
+	memset(&tio, 0, sizeof(tio));
+	if(tcgetattr(fd, &tio) != 0)
+	{
+		return -1;
+	}
+	cfmakeraw(&tio);
+	tio.c_cflag &= ~(CSIZE | PARENB | CSTOPB);
+	tio.c_cflag |= CS8 | CLOCAL | CREAD;
+#ifdef CRTSCTS
+	tio.c_cflag &= ~CRTSCTS;
+#endif
+	tio.c_iflag &= ~(IXON | IXOFF | IXANY);
+	tio.c_cc[VMIN] = 0;
+	tio.c_cc[VTIME] = 0;
+	speed_t speed = B115200;
+	if(tty_speed((baud == 0)?(115200):(baud), &speed) != 0)
+	{
+		tty_printf(verbose, "[%s] unsupported baud = %lu\n", __FUNCTION__, baud);
+		return -1;
+	}
+	(void)cfsetispeed(&tio, speed);
+	(void)cfsetospeed(&tio, speed);
+	if(tcsetattr(fd, TCSANOW, &tio) != 0)
+	{
+		return -1;
+	}
+	(void)tcflush(fd, TCIOFLUSH);
+	return 0;
+}
+
+static void tty_show(int fd, const char* path, const bool verbose)
+{
+	//i.e. what the driver took, it may round or refuse part of the settings without an error
+	struct termios tio;
+	memset(&tio, 0, sizeof(tio));
+	if(verbose == false || tcgetattr(fd, &tio) != 0)
+	{
+		return;
+	}
+	const speed_t speed = cfgetospeed(&tio);
+	unsigned long baud = 0;
+	size_t k = 0;
+	for(k = 0; k < sizeof(tty_bauds)/sizeof(tty_bauds[0]); k++)
+	{
+		if(tty_bauds[k].speed == speed)
+		{
+			baud = tty_bauds[k].baud;
+		}
+	}
+	const tcflag_t size = tio.c_cflag & CSIZE;
+	const int data_bits = (size == CS5)?(5):((size == CS6)?(6):((size == CS7)?(7):(8)));
+	const char parity = ((tio.c_cflag & PARENB) == 0)?('N'):(((tio.c_cflag & PARODD) != 0)?('O'):('E'));
+	const int stop_bits = ((tio.c_cflag & CSTOPB) != 0)?(2):(1);
+	tty_printf(verbose, "[%s] path = %s, baud = %lu, data bits = %d, parity = %c, stop bits = %d\n", __FUNCTION__, path, baud, data_bits, parity, stop_bits);
+}
+
+int tty_open(const char* path, unsigned long baud, const bool verbose)
+{
+	int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+	if(fd < 0)
+	{
+		tty_printf(verbose, "[%s] path = %s, errno = %d\n", __FUNCTION__, path, errno);
+		return -1;
+	}
+	if(tty_raw(fd, baud, verbose) != 0)
+	{
+		close(fd);
+		return -1;
+	}
+	tty_show(fd, path, verbose);
+	return fd;
+}
+
+void tty_close(int fd)
+{
+	(void)close(fd);
+}
+
+int tty_read(int fd, unsigned char* buf, const size_t BUF_SZ)
+{
+	//i.e. the same as ReadIntervalTimeout = MAXDWORD, it returns at once
+	ssize_t rret = read(fd, buf, BUF_SZ);
+	if(rret < 0)
+	{
+		if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+		{
+			return 0;
+		}
+		return -1;
+	}
+	return (int)rret;
+}
+
+static int tty_write_wait(int fd, const uint64_t deadline_us)
+{
+	//i.e. the link is full, the write fails when it does not drain by the deadline or a signal (e.g. Ctrl-C) comes in between
+	const uint64_t now = xport_now_us();
+	if(now >= deadline_us)
+	{
+		return -1;
+	}
+	struct pollfd pfd = {.fd = fd, .events = POLLOUT, .revents = 0};
+	int pret = poll(&pfd, 1, (int)((deadline_us - now + 999) / 1000));
+	if(pret < 0 || (pret > 0 && (pfd.revents & (POLLERR | POLLNVAL)) != 0))
+	{
+		return -1;
+	}
+	return 0;
+}
+
+int tty_write(int fd, const unsigned char* buf, const size_t BUF_SZ, const uint64_t timeout_us)
+{
+	const uint64_t deadline = xport_now_us() + timeout_us;
+	size_t done = 0;
+	while(done < BUF_SZ)
+	{
+		ssize_t wret = write(fd, buf + done, BUF_SZ - done);
+		if(wret < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				if(tty_write_wait(fd, deadline) != 0)
+				{
+					return -1;
+				}
+				continue;
+			}
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		done += (size_t)wret;
+	}
+	return (int)done;
+}
+
+int tty_writev(int fd, const struct xport_iov_t* iov, const int cnt, const uint64_t timeout_us)
+{
+	const uint64_t deadline = xport_now_us() + timeout_us;
+	struct iovec vec[8];
+	int n = 0;
+	size_t total = 0;
+	for(n = 0; n < cnt && n < (int)(sizeof(vec)/sizeof(vec[0])); n++)
+	{
+		vec[n].iov_base = (void*)iov[n].buf;
+		vec[n].iov_len = iov[n].len;
+		total += iov[n].len;
+	}
+	if(n < cnt)
+	{
+		return -1;
+	}
+	size_t done = 0;
+	struct iovec* v = vec;
+	while(done < total)
+	{
+		ssize_t wret = writev(fd, v, n);
+		if(wret < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+			{
+				if(tty_write_wait(fd, deadline) != 0)
+				{
+					return -1;
+				}
+				continue;
+			}
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return -1;
+		}
+		done += (size_t)wret;
+		//i.e. skip what went out, a short write may end in the middle of a piece
+		while(n > 0 && (size_t)wret >= v->iov_len)
+		{
+			wret -= v->iov_len;
+			v++;
+			n--;
+		}
+		if(n > 0)
+		{
+			v->iov_base = (char*)v->iov_base + wret;
+			v->iov_len -= wret;
+		}
+	}
+	return (int)done;
+}
+
+int tty_wait(int fd, const uint64_t timeout_us)
+{
+	struct pollfd pfd = {.fd = fd, .events = POLLIN, .revents = 0};
+#ifdef __linux__
+	struct timespec ts = {.tv_sec = timeout_us / 1000000, .tv_nsec = (timeout_us % 1000000) * 1000};
+	int pret = ppoll(&pfd, 1, &ts, NULL);
+#else
+	int pret = poll(&pfd, 1, (int)((timeout_us + 999) / 1000));
+#endif
+	if(pret < 0)
+	{
+		return (errno == EINTR)?(0):(-1);
+	}
+	if(pret > 0 && (pfd.revents & (POLLERR | POLLNVAL)) != 0)
+	{
+		return -1;
+	}
+	return (pret > 0)?(1):(0);
+}
+
+static int tty_xport_open(struct xport_t* xp, const char* name, unsigned long baud)
+{
+	char path[260] = {'\0'};
+	if(name[0] == '/')
+	{
+		snprintf(path, sizeof(path), "%s", name);
+	}
+	else
+	{
+		snprintf(path, sizeof(path), "/dev/%s", name);
+	}
+	int fd = tty_open(path, baud, xp->verbose);
+	if(fd < 0)
+	{
+		return -1;
+	}
+	xp->priv = (void*)(intptr_t)fd;
+	xp->caps = XPORT_CAP_BAUD | XPORT_CAP_WAIT;
+	xp->baud = (baud == 0)?(115200):(baud);
+	return 0;
+}
+
+static int tty_xport_read(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ)
+{
+	return tty_read((int)(intptr_t)xp->priv, buf, BUF_SZ);
+}
+
+static int tty_xport_write(struct xport_t* xp, const unsigned char* buf, const size_t BUF_SZ)
+{
+	return tty_write((int)(intptr_t)xp->priv, buf, BUF_SZ, xp->tx_timeout_us);
+}
+
+static int tty_xport_writev(struct xport_t* xp, const struct xport_iov_t* iov, const int cnt)
+{
+	return tty_writev((int)(intptr_t)xp->priv, iov, cnt, xp->tx_timeout_us);
+}
+
+static int tty_xport_wait(struct xport_t* xp, const uint64_t timeout_us)
+{
+	return tty_wait((int)(intptr_t)xp->priv, timeout_us);
+}
+
+static void tty_xport_close(struct xport_t* xp)
+{
+	tty_close((int)(intptr_t)xp->priv);
+}
+
+const struct xport_ops_t tty_xport_ops =
+{
+	.name = "tty",
+	.prefix = NULL,
+	.open = tty_xport_open,
+	.read = tty_xport_read,
+	.write = tty_xport_write,
+	.writev = tty_xport_writev,
+	.wait = tty_xport_wait,
+	.close = tty_xport_close,
+};
+
+#define TTY_PTY_DRAIN_TIMEOUT 1000 //i.e. in ms
+#define ms_to_us(ms) ((uint64_t)(ms) * 1000ULL)
+
+struct tty_pty_t
+{
+	int master;
+	int slave; //i.e. held open, otherwise the master reads EIO until the peer attaches
+	char link[260];
+	char slave_name[260]; //i.e. what the link points at
+};
+
+static bool tty_pty_link_is_ours(const char* link, const char* slave)
+{
+	//i.e. the link is removed only while it still points at this slave, another run may have taken the path over
+	char target[260] = {'\0'};
+	ssize_t len = readlink(link, target, sizeof(target) - sizeof(char));
+	return (len > 0 && strcmp(target, slave) == 0)?(true):(false);
+}
+
+static int tty_pty_xport_open(struct xport_t* xp, const char* name, unsigned long baud)
+{
+	//i.e. "pty" or "pty:/tmp/link", the peer attaches to the slave (or the link) as a plain tty
+	const char* link = name + strlen(TTY_PTY_PREFIX);
+	if(*link == ':')
+	{
+		link++;
+	}
+	else if(*link != '\0')
+	{
+		return -1;
+	}
+	struct tty_pty_t* pty = (struct tty_pty_t*)calloc(1, sizeof(struct tty_pty_t));
+	if(pty == NULL)
+	{
+		return -1;
+	}
+	pty->master = -1;
+	pty->slave = -1;
+	int ret = -1;
+	do
+	{
+		pty->master = posix_openpt(O_RDWR | O_NOCTTY);
+		if(pty->master < 0 || grantpt(pty->master) != 0 || unlockpt(pty->master) != 0)
+		{
+			break;
+		}
+		const char* slave = ptsname(pty->master);
+		if(slave == NULL)
+		{
+			break;
+		}
+		//i.e. the line discipline of a pty lives on the slave side, so raw mode is set there
+		pty->slave = tty_open(slave, baud, xp->verbose);
+		if(pty->slave < 0)
+		{
+			break;
+		}
+		int flags = fcntl(pty->master, F_GETFL, 0);
+		if(flags < 0 || fcntl(pty->master, F_SETFL, flags | O_NONBLOCK) != 0)
+		{
+			break;
+		}
+		if(strlen(link) > 0)
+		{
+			//i.e. only a stale link left behind by an earlier run is replaced, never a file of the user
+			struct stat st;
+			if(lstat(link, &st) == 0)
+			{
+				if(S_ISLNK(st.st_mode) == 0)
+				{
+					printf("pty: link = %s is there and is not a symlink, it is left alone\n", link);
+					break;
+				}
+				(void)unlink(link);
+			}
+			if(symlink(slave, link) != 0)
+			{
+				tty_printf(xp->verbose, "[%s] link = %s, errno = %d\n", __FUNCTION__, link, errno);
+				break;
+			}
+			snprintf(pty->link, sizeof(pty->link), "%s", link);
+			snprintf(pty->slave_name, sizeof(pty->slave_name), "%s", slave);
+		}
+		printf("pty: slave = %s%s%s\n", slave, (strlen(link) > 0)?(", link = "):(""), link);
+		fflush(stdout);
+		ret = 0;
+	} while(0);
+	if(ret != 0)
+	{
+		if(pty->slave >= 0)
+		{
+			close(pty->slave);
+		}
+		if(pty->master >= 0)
+		{
+			close(pty->master);
+		}
+		free(pty);
+		return -1;
+	}
+	xp->priv = (void*)pty;
+	xp->caps = XPORT_CAP_WAIT | XPORT_CAP_RELIABLE; //i.e. a pty is not paced at any baud
+	xp->baud = baud;
+	return 0;
+}
+
+static int tty_pty_xport_read(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ)
+{
+	return tty_read(((struct tty_pty_t*)xp->priv)->master, buf, BUF_SZ);
+}
+
+static int tty_pty_xport_write(struct xport_t* xp, const unsigned char* buf, const size_t BUF_SZ)
+{
+	return tty_write(((struct tty_pty_t*)xp->priv)->master, buf, BUF_SZ, xp->tx_timeout_us);
+}
+
+static int tty_pty_xport_writev(struct xport_t* xp, const struct xport_iov_t* iov, const int cnt)
+{
+	return tty_writev(((struct tty_pty_t*)xp->priv)->master, iov, cnt, xp->tx_timeout_us);
+}
+
+static int tty_pty_xport_wait(struct xport_t* xp, const uint64_t timeout_us)
+{
+	return tty_wait(((struct tty_pty_t*)xp->priv)->master, timeout_us);
+}
+
+static void tty_pty_xport_close(struct xport_t* xp)
+{
+	struct tty_pty_t* pty = (struct tty_pty_t*)xp->priv;
+	//i.e. closing the master hangs up the slave and discards what the peer has not read yet (e.g. the last ACK)
+	const uint64_t deadline = xport_now_us() + ms_to_us(TTY_PTY_DRAIN_TIMEOUT);
+	//NOTE: the last write may still be on its way to the slave queue, so it always waits once
+	int pending = 0;
+	do
+	{
+		(void)usleep(1000);
+	} while(ioctl(pty->slave, FIONREAD, &pending) == 0 && pending > 0 && xport_now_us() < deadline);
+	if(strlen(pty->link) > 0 && tty_pty_link_is_ours(pty->link, pty->slave_name) == true)
+	{
+		(void)unlink(pty->link);
+	}
+	close(pty->slave);
+	close(pty->master);
+	free(pty);
+}
+
+const struct xport_ops_t tty_pty_xport_ops =
+{
+	.name = "pty",
+	.prefix = TTY_PTY_PREFIX,
+	.open = tty_pty_xport_open,
+	.read = tty_pty_xport_read,
+	.write = tty_pty_xport_write,
+	.writev = tty_pty_xport_writev,
+	.wait = tty_pty_xport_wait,
+	.close = tty_pty_xport_close,
+};
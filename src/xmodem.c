@@ -1,13 +1,21 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <string.h>
-#include <synchapi.h>
+#include <sys/stat.h>
+#include <utime.h>
 
 #include "xmodem.h"
-#include "sp.h"
+#include "xport.h"
+#include "crc16.h"
+#include "stream.h"
+#include "lz.h"
 
 #define XMODEM_CRC_IND  'C'
+#define XMODEM_G_IND    'G' //i.e. streaming, frames are not acknowledged
+#define XMODEM_W_IND    'W' //i.e. sliding window, a response carries the block number and its complement
+#define XMODEM_R_IND    'R' //i.e. resume, the receiver offers the length and hash of the file it holds already
 #define XMODEM_CRC_HDR  0x01 //SOH
 #define XMODEM_1K_HDR   0x02 //STX
 #define XMODEM_EOT_HDR  0x04
@@ -15,15 +23,20 @@
 #define XMODEM_ACK      0x06
 #define XMODEM_NAK      0x15
 #define XMODEM_PAD      0x1A
+#define XMODEM_BS       0x08 //i.e. some transmitters follow their CANs with backspaces to clear them off a terminal
 
-#define XMODEM_INDICATE_TIMEOUT        100 //unit: ms
-#define XMODEM_INDICATE_MULTIPLICATION 10
+#define XMODEM_INDICATE_INTERVAL       1000 //unit: ms, i.e. the indication is repeated at such pace
 
-//TODO: transfer timeout shall be considered with the baud rate
-#define XMODEM_PKT_XFER_TIMEOUT        10 //unit: ms
-#define XMODEM_PKT_XFER_RETRY_COUNT    100
+#define XMODEM_PKT_XFER_TIMEOUT        1000 //unit: ms, i.e. it is used when the link has no baud rate (e.g. a socket)
+#define XMODEM_PKT_XFER_RETRY_COUNT    10
+#define XMODEM_TURNAROUND_MIN          20 //unit: ms, i.e. scheduling plus USB-serial latency timer
+#define XMODEM_SAFETY_FACTOR_DFT       4 //i.e. multiples of the frame time on the wire
 
-#define msleep(milliseconds)           Sleep(milliseconds)
+#define XMODEM_RTO_MIN                 2 //unit: ms
+#define XMODEM_RTO_MAX                 60000 //unit: ms
+#define XMODEM_RTT_GRANULARITY         1 //unit: ms
+
+#define ms_to_us(milliseconds)         ((uint64_t)(milliseconds) * 1000ULL)
 
 struct xmodem_crc_pkt_t
 {
@@ -43,6 +56,19 @@ struct xmodem_1k_pkt_t
 	uint16_t crc16;
 } __attribute__((packed)); //NOTE: #pragma pack(1) would be okay too
 
+#define XMODEM_CRC_DATA_SZ sizeof(((struct xmodem_crc_pkt_t*)0)->data)
+#define XMODEM_1K_DATA_SZ  sizeof(((struct xmodem_1k_pkt_t*)0)->data)
+
+#define XMODEM_RESUME_OFFER_CNT 3 //i.e. offers left unanswered before a transmitter is taken to know nothing of resuming
+#define XMODEM_RESUME_OFFER_SZ  37 //i.e. 'R', then offset, hash and CRC in hex
+#define XMODEM_CKPT_SUFFIX      ".ckpt"
+#define XMODEM_STRIPE_TAG       "stripe" //i.e. in block 0, followed by the index and count of the segment, its offset and the size of the file
+#define XMODEM_HASH_INIT        0xcbf29ce484222325ULL //i.e. FNV-1a, 64-bit
+#define XMODEM_HASH_PRIME       0x100000001b3ULL
+
+#define XMODEM_BLK_DOWN_ERRS 2  //i.e. consecutive errors which make 1K frames step down to 128
+#define XMODEM_BLK_UP_RUN    16 //i.e. clean 128-byte frames in a row which make them step back up to 1K
+
 enum xmodem_state_t
 {
 	xmodem_state_initial = 0,
@@ -50,10 +76,12 @@ enum xmodem_state_t
 	xmodem_state_wait,
 	xmodem_state_wait_term,
 	xmodem_state_wait_canc,
-	xmodem_state_hdr_rcv,
-	xmodem_state_pkt_num_rcv,
-	xmodem_state_data_rcv,
+	xmodem_state_wait_file,
+	xmodem_state_frame_rcv,
+	xmodem_state_hdr_load,
+	xmodem_state_data_load,
 	xmodem_state_data_xmt,
+	xmodem_state_window_xmt,
 	xmodem_state_ack_xmt,
 	xmodem_state_nak_xmt,
 	xmodem_state_can_xmt,
@@ -69,10 +97,12 @@ static const char* xmodem_state_s[] =
 	"wait",
 	"wait_term",
 	"wait_canc",
-	"hdr_rcv",
-	"pkt_num_rcv",
-	"data_rcv",
+	"wait_file",
+	"frame_rcv",
+	"hdr_load",
+	"data_load",
 	"data_xmt",
+	"window_xmt",
 	"ack_xmt",
 	"nak_xmt",
 	"can_xmt",
@@ -81,353 +111,1179 @@ static const char* xmodem_state_s[] =
 	"fail",
 };
 
-static bool verbose = false;
+//NOTE: there is no state outside a session, so the flag is the one of the session (or a copy of it) at each call
+#define xmodem_printf(verbose, fmt, ...) \
+	do { if((verbose) == true) printf(fmt, __VA_ARGS__); } while(0)
+
+struct xmodem_timeout_t
+{
+	uint64_t byte_us;  //i.e. time on the wire of one byte
+	uint64_t frame_us; //i.e. time on the wire of one frame
+	uint64_t ack_us;   //i.e. longest silence within a frame, and the initial retransmission time-out
+	uint64_t purge_us; //i.e. quiet time which ends the purge of a broken frame
+};
 
-void xmodem_verb_clear(void)
+static void xmodem_timeout_calc(struct xmodem_timeout_t* to, const struct xmodem_session_t* xs, const size_t frame_sz)
 {
-	verbose = false;
+	const struct xport_t* xp = xs->xp;
+	const unsigned int safety_factor = (xs->safety_factor == 0)?(XMODEM_SAFETY_FACTOR_DFT):(xs->safety_factor);
+	if((xport_caps(xp) & XPORT_CAP_BAUD) == 0 || xp->baud == 0)
+	{
+		to->byte_us = 0;
+		to->frame_us = 0;
+		to->ack_us = ms_to_us(XMODEM_PKT_XFER_TIMEOUT);
+		to->purge_us = ms_to_us(XMODEM_TURNAROUND_MIN);
+	}
+	else
+	{
+		//i.e. 8N1 takes 10 bits per byte
+		to->byte_us = (10ULL * 1000000ULL + xp->baud - 1) / xp->baud;
+		to->frame_us = to->byte_us * frame_sz;
+		to->ack_us = to->frame_us * safety_factor + ms_to_us(XMODEM_TURNAROUND_MIN);
+		to->purge_us = to->byte_us * 16 + ms_to_us(XMODEM_TURNAROUND_MIN);
+	}
+	xmodem_printf(xs->verbose, "[%s] baud = %lu, frame_sz = %u, frame_us = %llu, ack_us = %llu\n", __FUNCTION__, xp->baud, (unsigned int)frame_sz, (unsigned long long)to->frame_us, (unsigned long long)to->ack_us);
 }
 
-void xmodem_verb_set(void)
+static void xmodem_rtt_reset(struct xmodem_rtt_t* rtt, const struct xmodem_timeout_t* to)
 {
-	verbose = true;
+	//i.e. the static time-out is used until the first sample arrives
+	rtt->srtt_us = 0;
+	rtt->rttvar_us = 0;
+	rtt->rto_us = to->ack_us;
+	//i.e. a damaged frame is NAKed only after the line has been quiet for purge_us, a resend before that collides with the purge
+	rtt->rto_min_us = to->frame_us + to->purge_us * 2;
+	if(rtt->rto_min_us < ms_to_us(XMODEM_RTO_MIN))
+	{
+		rtt->rto_min_us = ms_to_us(XMODEM_RTO_MIN);
+	}
+	rtt->rto_max_us = ms_to_us(XMODEM_RTO_MAX);
+	rtt->samples = 0;
 }
 
-#define xmodem_printf(fmt, ...) \
-	do { if(verbose == true) printf(fmt, __VA_ARGS__); } while(0)
+static void xmodem_rtt_sample(struct xmodem_rtt_t* rtt, const uint64_t r_us)
+{
+	//i.e. the same estimator as TCP (RFC 6298)
+	if(rtt->samples == 0)
+	{
+		rtt->srtt_us = r_us;
+		rtt->rttvar_us = r_us / 2;
+	}
+	else
+	{
+		uint64_t delta = (rtt->srtt_us > r_us)?(rtt->srtt_us - r_us):(r_us - rtt->srtt_us);
+		rtt->rttvar_us = (3 * rtt->rttvar_us + delta) / 4;
+		rtt->srtt_us = (7 * rtt->srtt_us + r_us) / 8;
+	}
+	rtt->samples++;
+	uint64_t var_us = 4 * rtt->rttvar_us;
+	if(var_us < ms_to_us(XMODEM_RTT_GRANULARITY))
+	{
+		var_us = ms_to_us(XMODEM_RTT_GRANULARITY);
+	}
+	rtt->rto_us = rtt->srtt_us + var_us;
+	if(rtt->rto_us < rtt->rto_min_us)
+	{
+		rtt->rto_us = rtt->rto_min_us;
+	}
+	if(rtt->rto_us > rtt->rto_max_us)
+	{
+		rtt->rto_us = rtt->rto_max_us;
+	}
+}
+
+static void xmodem_rtt_backoff(struct xmodem_rtt_t* rtt)
+{
+	rtt->rto_us *= 2;
+	if(rtt->rto_us > rtt->rto_max_us)
+	{
+		rtt->rto_us = rtt->rto_max_us;
+	}
+}
+
+static uint64_t xmodem_rtt_idle(const struct xmodem_rtt_t* rtt, const struct xmodem_timeout_t* to)
+{
+	//i.e. the receiver NAKs an idle line later than the transmitter would resend
+	uint64_t idle_us = 2 * rtt->rto_us;
+	return (idle_us > to->ack_us)?(idle_us):(to->ack_us);
+}
+
+void xmodem_session_init(struct xmodem_session_t* xs, struct xport_t* xp, const short ind_time, xmodem_keep_xfer_cb keep_xfer_cb)
+{
+	memset(xs, 0, sizeof(struct xmodem_session_t));
+	xs->xp = xp;
+	xs->ind_time = ind_time;
+	xs->keep_xfer_cb = keep_xfer_cb;
+}
 
-//NOTE: mixed size transmission is unsupported
+void xmodem_session_rtt(const struct xmodem_session_t* xs, struct xmodem_rtt_t* rtt)
+{
+	memcpy(rtt, &xs->rtt, sizeof(struct xmodem_rtt_t));
+}
 
-struct data_block_t
+static short xmodem_pad_count(const uint8_t* data, const size_t data_sz)
 {
-	unsigned char* data;
+	//i.e. trailing XMODEM_PAD of a block, the first byte is never counted
+	short pad_cnt = 0;
+	size_t j = 0;
+	for(j = data_sz - 1; j > 0; j--)
+	{
+		if(data[j] == XMODEM_PAD)
+		{
+			pad_cnt++;
+		}
+		else
+		{
+			break;
+		}
+	}
+	return pad_cnt;
+}
+
+struct xmodem_ckpt_t
+{
+	uint64_t offset; //i.e. bytes of the file confirmed so far
+	uint64_t hash;   //i.e. of those bytes
+};
+
+static uint64_t xmodem_hash_update(uint64_t hash, const uint8_t* data, const size_t len)
+{
+	size_t j = 0;
+	for(j = 0; j < len; j++)
+	{
+		hash ^= data[j];
+		hash *= XMODEM_HASH_PRIME;
+	}
+	return hash;
+}
+
+struct xmodem_rx_snk_t
+{
+	struct stream_snk_t* snk;
+	const struct xmodem_sink_t* out; //i.e. of the caller, which takes the blocks instead of snk
+	struct lz_dec_t* dec;       //i.e. the file arrives compressed, its blocks are restored on the way to snk
+	bool is_probed;             //i.e. the first block of the file was checked for a container
+	bool is_shared;             //i.e. a segment, written from offset on into a file other links fill too
+	uint64_t offset;
+	const char* fn;
+	struct xmodem_ckpt_t* ckpt; //i.e. NULL unless resuming, it follows the bytes written to the file
+	uint64_t* stored;           //i.e. rx_bytes of the session
+	bool verbose;
+};
+
+static int xmodem_sink_open(struct xmodem_rx_snk_t* rs)
+{
+	rs->snk = (rs->is_shared == true)?(stream_snk_open_in(rs->fn, rs->offset, rs->verbose)):(stream_snk_open(rs->fn, rs->verbose));
+	return (rs->snk != NULL)?(0):(-1);
+}
+
+static int xmodem_sink_append(struct xmodem_rx_snk_t* rs, const uint8_t* data, const size_t data_sz)
+{
+	//i.e. the output file is created by the first accepted block, so a failed handshake leaves it alone
+	if(rs->out != NULL)
+	{
+		int wret = rs->out->write(rs->out->ctx, data, data_sz);
+		*rs->stored += (wret == 0)?(data_sz):(0);
+		return (wret == 0)?(0):(-1);
+	}
+	if(rs->snk == NULL && xmodem_sink_open(rs) != 0)
+	{
+		return -1;
+	}
+	if(stream_snk_write(rs->snk, data, data_sz) != (int)data_sz)
+	{
+		return -1;
+	}
+	*rs->stored += data_sz;
+	if(rs->ckpt != NULL)
+	{
+		rs->ckpt->offset += data_sz;
+		rs->ckpt->hash = xmodem_hash_update(rs->ckpt->hash, data, data_sz);
+	}
+	return 0;
+}
+
+static int xmodem_sink_lz_write(void* ctx, const uint8_t* buf, size_t len)
+{
+	return xmodem_sink_append((struct xmodem_rx_snk_t*)ctx, buf, len);
+}
+
+static int xmodem_sink_finish(struct xmodem_rx_snk_t* rs, const long long mtime)
+{
+	//i.e. a file without blocks is still created, and it gets the modification time of the original when known
+	//NOTE: a compressed file is only complete when the container restored all of its length
+	int dret = (rs->dec != NULL)?(lz_dec_close(rs->dec)):(0);
+	rs->dec = NULL;
+	rs->is_probed = false;
+	if(rs->out != NULL)
+	{
+		return dret;
+	}
+	if(rs->snk == NULL && xmodem_sink_open(rs) != 0)
+	{
+		return -1;
+	}
+	int cret = stream_snk_close(rs->snk);
+	rs->snk = NULL;
+	rs->is_shared = false;
+	rs->offset = 0;
+	if(cret == 0 && mtime >= 0)
+	{
+		struct utimbuf ut = {.actime = (time_t)mtime, .modtime = (time_t)mtime};
+		(void)utime(rs->fn, &ut);
+	}
+	return (dret == 0)?(cret):(-1);
+}
+
+static int xmodem_sink_buf_write(void* ctx, const uint8_t* buf, size_t len)
+{
+	//i.e. a growable buffer doubles, so the blocks of a long transfer are not reallocated one by one
+	struct xmodem_buf_t* b = (struct xmodem_buf_t*)ctx;
+	if(len > b->cap - b->len && b->is_growable == false)
+	{
+		//i.e. a fixed buffer sized to the payload takes it whole, the padding of the last block is dropped when only padding does not fit
+		size_t k = b->cap - b->len;
+		while(k < len && buf[k] == XMODEM_PAD)
+		{
+			k++;
+		}
+		if(k < len)
+		{
+			return -1;
+		}
+		len = b->cap - b->len;
+	}
+	if(len > b->cap - b->len)
+	{
+		size_t cap = (b->cap == 0)?(XMODEM_1K_DATA_SZ):(b->cap);
+		while(cap - b->len < len && cap <= SIZE_MAX / 2)
+		{
+			cap *= 2;
+		}
+		uint8_t* data = (b->is_growable == true && cap - b->len >= len)?((uint8_t*)realloc(b->data, cap)):(NULL);
+		if(data == NULL)
+		{
+			return -1;
+		}
+		b->data = data;
+		b->cap = cap;
+	}
+	memcpy(&b->data[b->len], buf, len);
+	b->len += len;
+	return 0;
+}
+
+void xmodem_sink_buf(struct xmodem_sink_t* snk, struct xmodem_buf_t* buf)
+{
+	snk->write = xmodem_sink_buf_write;
+	snk->ctx = buf;
+}
+
+void xmodem_source_buf(struct xmodem_source_t* src, const uint8_t* data, const size_t len)
+{
+	src->data = data;
+	src->read = NULL;
+	src->ctx = NULL;
+	src->size = (uint64_t)len;
+}
+
+static void xmodem_ckpt_path(char* path, const size_t PATH_SZ, const char* fn)
+{
+	(void)snprintf(path, PATH_SZ, "%s%s", fn, XMODEM_CKPT_SUFFIX);
+}
+
+static int xmodem_ckpt_load(const char* fn, struct xmodem_ckpt_t* ckpt, const bool verbose)
+{
+	//i.e. 0 only when the file still starts with the bytes the checkpoint describes
+	char path[272] = {'\0'};
+	xmodem_ckpt_path(path, sizeof(path), fn);
+	FILE* fp = fopen(path, "r");
+	if(fp == NULL)
+	{
+		return -1;
+	}
+	unsigned long long offset = 0;
+	unsigned long long hash = 0;
+	int cnt = fscanf(fp, "%llu %llx", &offset, &hash);
+	fclose(fp);
+	if(cnt != 2 || offset == 0)
+	{
+		return -1;
+	}
+	struct stream_src_t* src = stream_src_open(fn, verbose);
+	if(src == NULL)
+	{
+		return -1;
+	}
+	uint8_t buf[4096] = {0x0};
+	uint64_t done = 0;
+	uint64_t h = XMODEM_HASH_INIT;
+	while(done < offset)
+	{
+		size_t want = (offset - done < sizeof(buf))?((size_t)(offset - done)):(sizeof(buf));
+		int rret = stream_src_read(src, buf, want);
+		if(rret <= 0)
+		{
+			break;
+		}
+		h = xmodem_hash_update(h, buf, rret);
+		done += rret;
+	}
+	stream_src_close(src);
+	if(done != offset || h != hash)
+	{
+		xmodem_printf(verbose, "[%s] fn = %s, checkpoint does not match (%llu of %llu bytes)\n", __FUNCTION__, fn, (unsigned long long)done, offset);
+		return -1;
+	}
+	ckpt->offset = offset;
+	ckpt->hash = hash;
+	return 0;
+}
+
+static int xmodem_ckpt_save(const char* fn, const struct xmodem_ckpt_t* ckpt)
+{
+	//NOTE: it is written once the file is closed, so it never describes bytes which did not reach the file
+	char path[272] = {'\0'};
+	xmodem_ckpt_path(path, sizeof(path), fn);
+	FILE* fp = fopen(path, "w");
+	if(fp == NULL)
+	{
+		return -1;
+	}
+	int pret = fprintf(fp, "%llu %016llx\n", (unsigned long long)ckpt->offset, (unsigned long long)ckpt->hash);
+	return (fclose(fp) == 0 && pret > 0)?(0):(-1);
+}
+
+static void xmodem_ckpt_remove(const char* fn)
+{
+	char path[272] = {'\0'};
+	xmodem_ckpt_path(path, sizeof(path), fn);
+	(void)remove(path);
+}
+
+static void xmodem_resume_build(uint8_t* buf, const struct xmodem_ckpt_t* ckpt)
+{
+	//i.e. in lowercase hex, so no byte of it reads as an indication to a transmitter which knows nothing of resuming
+	char text[XMODEM_RESUME_OFFER_SZ + 1] = {'\0'};
+	(void)snprintf(text, sizeof(text), "%c%016llx%016llx", XMODEM_R_IND, (unsigned long long)ckpt->offset, (unsigned long long)ckpt->hash);
+	uint16_t crc16 = crc16_update(0, (const uint8_t*)&text[1], 32);
+	(void)snprintf(&text[33], sizeof(text) - 33, "%04x", (unsigned int)crc16);
+	memcpy(buf, text, XMODEM_RESUME_OFFER_SZ);
+}
+
+static int xmodem_resume_parse(const uint8_t* buf, struct xmodem_ckpt_t* ckpt)
+{
+	//i.e. the offer is protected like a frame, so line noise is never taken for one
+	char text[XMODEM_RESUME_OFFER_SZ + 1] = {'\0'};
+	memcpy(text, buf, XMODEM_RESUME_OFFER_SZ);
+	if(text[0] != XMODEM_R_IND || strspn(&text[1], "0123456789abcdef") != XMODEM_RESUME_OFFER_SZ - 1)
+	{
+		return -1;
+	}
+	unsigned int crc16 = 0;
+	unsigned long long offset = 0;
+	unsigned long long hash = 0;
+	if(sscanf(&text[33], "%4x", &crc16) != 1 || crc16 != crc16_update(0, (const uint8_t*)&text[1], 32))
+	{
+		return -1;
+	}
+	text[33] = '\0';
+	if(sscanf(&text[17], "%16llx", &hash) != 1)
+	{
+		return -1;
+	}
+	text[17] = '\0';
+	if(sscanf(&text[1], "%16llx", &offset) != 1)
+	{
+		return -1;
+	}
+	ckpt->offset = offset;
+	ckpt->hash = hash;
+	return 0;
+}
+
+static const char* xmodem_basename(const char* fn)
+{
+	const char* base = fn;
+	const char* p = fn;
+	for(p = fn; *p != '\0'; p++)
+	{
+		if(*p == '/' || *p == '\\')
+		{
+			base = p + 1;
+		}
+	}
+	return base;
+}
+
+static size_t xmodem_hdr_build(uint8_t* data, const size_t BUF_SZ, const char* fn, const struct xmodem_stripe_t* stripe)
+{
+	//i.e. block 0 of YMODEM: the name, then its length in decimal, modification time and mode in octal
+	//NOTE: an empty block ends the batch, and the size of the block (128 or 1K) is returned
+	//NOTE: a segment gives its own length, and its place follows the serial number, the last field YMODEM defines
+	memset(data, 0x0, BUF_SZ);
+	if(fn == NULL)
+	{
+		return XMODEM_CRC_DATA_SZ;
+	}
+	struct stat st;
+	memset(&st, 0, sizeof(st));
+	(void)stat(fn, &st);
+	const char* base = xmodem_basename(fn);
+	size_t len = strlen(base);
+	if(len > BUF_SZ - 128)
+	{
+		len = BUF_SZ - 128;
+	}
+	memcpy(data, base, len);
+	len++;
+	const unsigned long long size = (stripe != NULL)?(stripe->len):((unsigned long long)st.st_size);
+	len += snprintf((char*)&data[len], BUF_SZ - len, "%llu %llo %o", size, (unsigned long long)st.st_mtime, (unsigned int)(st.st_mode & 0777));
+	if(stripe != NULL)
+	{
+		len += snprintf((char*)&data[len], BUF_SZ - len, " 0 %s %u %u %llu %llu", XMODEM_STRIPE_TAG, (unsigned int)stripe->idx, (unsigned int)stripe->cnt, (unsigned long long)stripe->offset, (unsigned long long)stripe->size);
+	}
+	return (len < XMODEM_CRC_DATA_SZ)?(XMODEM_CRC_DATA_SZ):(XMODEM_1K_DATA_SZ);
+}
+
+static int xmodem_hdr_parse(const uint8_t* data, const size_t DATA_SZ, const char* dir, char* path, const size_t PATH_SZ, uint64_t* size, long long* mtime, struct xmodem_stripe_t* seg)
+{
+	//i.e. 1 for a file, 0 for the end of the batch, -1 for a block 0 which can not be used
+	const char* name = (const char*)data;
+	const uint8_t* nul = (const uint8_t*)memchr(data, '\0', DATA_SZ);
+	if(nul == NULL)
+	{
+		return -1;
+	}
+	if(name[0] == '\0')
+	{
+		return 0;
+	}
+	//NOTE: only the last component is used, so a name from the peer can not leave the directory
+	const char* base = xmodem_basename(name);
+	if(base[0] == '\0' || strcmp(base, ".") == 0 || strcmp(base, "..") == 0)
+	{
+		return -1;
+	}
+	int n = snprintf(path, PATH_SZ, "%s/%s", dir, base);
+	if(n < 0 || (size_t)n >= PATH_SZ)
+	{
+		return -1;
+	}
+	//i.e. the fields after the name are optional
+	char meta[128] = {'\0'};
+	size_t meta_len = DATA_SZ - (size_t)(nul + 1 - data);
+	if(meta_len >= sizeof(meta))
+	{
+		meta_len = sizeof(meta) - 1;
+	}
+	memcpy(meta, nul + 1, meta_len);
+	unsigned long long sz = 0;
+	unsigned long long mt = 0;
+	int cnt = sscanf(meta, "%llu %llo", &sz, &mt);
+	*size = (cnt >= 1)?((uint64_t)sz):(UINT64_MAX);
+	*mtime = (cnt >= 2)?((long long)mt):(-1);
+	seg->cnt = 0;
+	const char* tag = strstr(meta, " " XMODEM_STRIPE_TAG " ");
+	if(tag != NULL)
+	{
+		unsigned int idx = 0;
+		unsigned int seg_cnt = 0;
+		unsigned long long offset = 0;
+		unsigned long long total = 0;
+		int sret = sscanf(tag + strlen(XMODEM_STRIPE_TAG) + 2, "%u %u %llu %llu", &idx, &seg_cnt, &offset, &total);
+		if(sret != 4 || seg_cnt == 0 || seg_cnt > 0xffff || idx >= seg_cnt || cnt < 1 || offset > total || sz > total - offset)
+		{
+			return -1;
+		}
+		seg->idx = (unsigned short)idx;
+		seg->cnt = (unsigned short)seg_cnt;
+		seg->offset = (uint64_t)offset;
+		seg->len = (uint64_t)sz;
+		seg->size = (uint64_t)total;
+	}
+	return 1;
+}
+
+struct xmodem_frame_t
+{
+	uint8_t buf[sizeof(struct xmodem_1k_pkt_t)]; //i.e. header, block and CRC, the block may stay in the mapping
+	const uint8_t* blk;
 	size_t data_sz;
-	struct data_block_t* next;
+	int len;       //i.e. bytes taken from the file, 0 means the end and -1 a read error
+	bool is_ready; //i.e. encoded and waiting to be sent
+};
+
+struct xmodem_tx_src_t
+{
+	struct stream_src_t* src;
+	struct stream_map_t* map;
+	const struct xmodem_source_t* in; //i.e. of the caller, used instead of a file, it stays set across a reopen
+	struct lz_enc_t* enc; //i.e. with compression, made at the first block so a resume skips the file itself
+	uint64_t size; //i.e. of the file when it was opened, or the end of a segment
+	uint64_t pos;  //i.e. where the next byte is taken from the file itself
+	bool is_lz;
+	bool is_seg;   //i.e. a segment of the file, nothing after size is read
+	bool verbose;  //i.e. of the session, it stays set across a reopen
+	uint8_t carry[2 * XMODEM_1K_DATA_SZ]; //i.e. blocks taken back from 1K frames when the block size steps down
+	size_t carry_len;
+	size_t carry_pos;
+};
+
+static int xmodem_tx_raw(struct xmodem_tx_src_t* tx, uint8_t* data, const uint8_t** blk, size_t want)
+{
+	//i.e. bytes of the file itself, a block is used in place only when it lies whole in the mapping or the buffer of the caller
+	int done = 0;
+	*blk = data;
+	if(tx->is_seg == true && tx->size - tx->pos < want)
+	{
+		want = (size_t)(tx->size - tx->pos);
+	}
+	if(tx->in != NULL && tx->in->read == NULL)
+	{
+		const size_t cnt = (tx->size - tx->pos < want)?((size_t)(tx->size - tx->pos)):(want);
+		if(cnt == want)
+		{
+			*blk = &tx->in->data[tx->pos];
+		}
+		else if(cnt > 0)
+		{
+			memcpy(data, &tx->in->data[tx->pos], cnt); //i.e. an empty buffer may be NULL
+		}
+		done = (int)cnt;
+	}
+	else if(tx->in != NULL)
+	{
+		//NOTE: the caller may give fewer bytes than asked, only 0 ends the source
+		while((size_t)done < want)
+		{
+			int rret = tx->in->read(tx->in->ctx, &data[done], want - done);
+			if(rret <= 0)
+			{
+				done = (rret < 0)?(-1):(done);
+				break;
+			}
+			done += rret;
+		}
+	}
+	else if(tx->map != NULL)
+	{
+		const uint8_t* p = NULL;
+		size_t cnt = stream_map_next(tx->map, &p, want);
+		if(cnt == want)
+		{
+			*blk = p;
+		}
+		else if(cnt > 0)
+		{
+			memcpy(data, p, cnt); //i.e. an empty file has no mapping
+		}
+		done = (int)cnt;
+	}
+	else
+	{
+		done = stream_src_read(tx->src, data, want);
+	}
+	tx->pos += (done > 0)?(done):(0);
+	return done;
+}
+
+static int xmodem_tx_lz_read(void* ctx, uint8_t* buf, size_t len)
+{
+	const uint8_t* blk = NULL;
+	int rret = xmodem_tx_raw((struct xmodem_tx_src_t*)ctx, buf, &blk, len);
+	if(rret > 0 && blk != buf)
+	{
+		memcpy(buf, blk, rret);
+	}
+	return rret;
+}
+
+static int xmodem_tx_load(struct xmodem_tx_src_t* tx, uint8_t* data, const uint8_t** blk, const size_t DATA_SZ)
+{
+	//i.e. carried bytes come first, then the container when compressing, else the file itself
+	*blk = data;
+	size_t done = 0;
+	if(tx->src == NULL && tx->map == NULL && tx->in == NULL)
+	{
+		return 0; //i.e. no file, as for the block 0 which ends a batch
+	}
+	if(tx->carry_pos < tx->carry_len)
+	{
+		done = tx->carry_len - tx->carry_pos;
+		if(done > DATA_SZ)
+		{
+			done = DATA_SZ;
+		}
+		memcpy(data, &tx->carry[tx->carry_pos], done);
+		tx->carry_pos += done;
+		if(tx->carry_pos == tx->carry_len)
+		{
+			tx->carry_pos = 0;
+			tx->carry_len = 0;
+		}
+	}
+	if(tx->is_lz == true && tx->enc == NULL && tx->pos < tx->size)
+	{
+		//NOTE: an empty rest is sent plain, the receiver has no block to find a container in then
+		tx->enc = lz_enc_open(xmodem_tx_lz_read, tx, tx->size - tx->pos);
+		if(tx->enc == NULL)
+		{
+			return -1;
+		}
+	}
+	if(done < DATA_SZ && tx->enc != NULL)
+	{
+		int rret = lz_enc_read(tx->enc, &data[done], DATA_SZ - done);
+		if(rret < 0)
+		{
+			return -1;
+		}
+		done += rret;
+	}
+	else if(done < DATA_SZ)
+	{
+		//NOTE: only the last partial block needs a padded copy
+		const uint8_t* p = NULL;
+		int rret = xmodem_tx_raw(tx, &data[done], &p, DATA_SZ - done);
+		if(rret < 0)
+		{
+			return -1;
+		}
+		if(done == 0 && p != data)
+		{
+			*blk = p;
+			return rret;
+		}
+		if(p != &data[done])
+		{
+			memcpy(&data[done], p, rret);
+		}
+		done += rret;
+	}
+	return (int)done;
+}
+
+static int xmodem_tx_open(struct xmodem_tx_src_t* tx, const char* fn, const bool is_mmap, const bool is_lz, const struct xmodem_stripe_t* stripe)
+{
+	//i.e. with stripe, only its segment of the file is sent
+	if(tx->in != NULL)
+	{
+		//i.e. the source of the caller is there already, it is only taken from the start again
+		tx->pos = 0;
+		tx->size = tx->in->size;
+		tx->is_lz = is_lz;
+		return 0;
+	}
+	if(fn == NULL)
+	{
+		return 0;
+	}
+	struct stat st;
+	if(stat(fn, &st) != 0)
+	{
+		return -1;
+	}
+	if(stripe != NULL && (stripe->offset > (uint64_t)st.st_size || stripe->len > (uint64_t)st.st_size - stripe->offset))
+	{
+		return -1;
+	}
+	tx->is_seg = (stripe != NULL)?(true):(false);
+	tx->pos = (stripe != NULL)?(stripe->offset):(0);
+	tx->size = (stripe != NULL)?(stripe->offset + stripe->len):((uint64_t)st.st_size);
+	tx->is_lz = is_lz;
+	if(is_mmap == true)
+	{
+		tx->map = stream_map_open(fn, tx->verbose);
+		if(tx->map != NULL)
+		{
+			stream_map_seek(tx->map, tx->pos);
+		}
+	}
+	else
+	{
+		tx->src = stream_src_open_at(fn, tx->pos, tx->verbose);
+	}
+	return (tx->src != NULL || tx->map != NULL)?(0):(-1);
+}
+
+static void xmodem_tx_close(struct xmodem_tx_src_t* tx)
+{
+	lz_enc_close(tx->enc);
+	stream_src_close(tx->src);
+	stream_map_close(tx->map);
+	tx->enc = NULL;
+	tx->src = NULL;
+	tx->map = NULL;
+	tx->carry_len = 0;
+	tx->carry_pos = 0;
+}
+
+static int xmodem_tx_skip(struct xmodem_tx_src_t* tx, const uint64_t offset, uint64_t* hash)
+{
+	//i.e. the file is moved past offset bytes and hashed on the way, 0 when all of them were there
+	//NOTE: it is just opened, so nothing is carried and a container would start after these bytes
+	if(tx->in != NULL && tx->in->read != NULL && offset > 0)
+	{
+		return -1; //i.e. a read callback cannot go back, so its source is sent from the start
+	}
+	uint8_t buf[4096] = {0x0};
+	uint64_t done = 0;
+	*hash = XMODEM_HASH_INIT;
+	while(done < offset)
+	{
+		const size_t want = (offset - done < sizeof(buf))?((size_t)(offset - done)):(sizeof(buf));
+		const uint8_t* blk = NULL;
+		int lret = xmodem_tx_raw(tx, buf, &blk, want);
+		if(lret <= 0)
+		{
+			break;
+		}
+		*hash = xmodem_hash_update(*hash, blk, lret);
+		done += lret;
+	}
+	return (done == offset)?(0):(-1);
+}
+
+static void xmodem_tx_carry(struct xmodem_tx_src_t* tx, struct xmodem_frame_t* frame)
+{
+	//i.e. the block of a frame which is not going out goes back to be cut again, in file order
+	//NOTE: 1K frames are only encoded with nothing carried, so the blocks of two of them always fit
+	if(frame->is_ready == true && frame->len > 0)
+	{
+		memcpy(&tx->carry[tx->carry_len], frame->blk, frame->len);
+		tx->carry_len += frame->len;
+	}
+	frame->is_ready = false;
+}
+
+static void xmodem_frame_encode(struct xmodem_frame_t* frame, struct xmodem_tx_src_t* tx, const size_t DATA_SZ, const uint8_t pkt_num);
+
+static bool xmodem_tx_step_down(struct xmodem_tx_src_t* tx, struct xmodem_frame_t* frame, struct xmodem_frame_t* next, const bool is_nak_only)
+{
+	//i.e. true means the current frame was cut again, with the same block number, at the smaller size
+	if(is_nak_only == false)
+	{
+		//NOTE: the receiver may hold this block already and its ACK was lost, so it is resent unchanged
+		xmodem_tx_carry(tx, next);
+		return false;
+	}
+	xmodem_tx_carry(tx, frame);
+	xmodem_tx_carry(tx, next);
+	xmodem_frame_encode(frame, tx, XMODEM_CRC_DATA_SZ, frame->buf[1]);
+	return true;
+}
+
+static void xmodem_frame_seal(struct xmodem_frame_t* frame, const size_t DATA_SZ, const uint8_t pkt_num)
+{
+	//i.e. header, block number and CRC around a block which is in place already
+	frame->data_sz = DATA_SZ;
+	frame->buf[0] = (DATA_SZ == XMODEM_1K_DATA_SZ)?(XMODEM_1K_HDR):(XMODEM_CRC_HDR);
+	frame->buf[1] = pkt_num;
+	frame->buf[2] = (uint8_t)(255 - pkt_num);
+	uint16_t crc16 = crc16_update(0, frame->blk, DATA_SZ);
+	frame->buf[3 + DATA_SZ] = (uint8_t)(crc16 >> 8); //i.e. big-endian on the wire
+	frame->buf[4 + DATA_SZ] = (uint8_t)(crc16 & 0xff);
+	frame->is_ready = true;
+}
+
+static void xmodem_frame_encode(struct xmodem_frame_t* frame, struct xmodem_tx_src_t* tx, const size_t DATA_SZ, const uint8_t pkt_num)
+{
+	//i.e. everything a frame needs before it goes out, so a resend never recomputes it
+	uint8_t* data = &frame->buf[3];
+	frame->data_sz = DATA_SZ;
+	frame->len = xmodem_tx_load(tx, data, &frame->blk, DATA_SZ);
+	if(frame->len > 0)
+	{
+		if((size_t)frame->len < DATA_SZ)
+		{
+			memset(&data[frame->len], XMODEM_PAD, DATA_SZ - frame->len);
+		}
+		xmodem_frame_seal(frame, DATA_SZ, pkt_num);
+	}
+	frame->is_ready = true;
+}
+
+static int xmodem_frame_write(struct xport_t* xp, const struct xmodem_frame_t* frame)
+{
+	//i.e. a block still in the mapping is sent between the header and the CRC of the frame without being copied
+	const size_t DATA_SZ = frame->data_sz;
+	const size_t FRAME_SZ = DATA_SZ + 5;
+	if(frame->blk == &frame->buf[3])
+	{
+		return xport_write(xp, frame->buf, FRAME_SZ);
+	}
+	struct xport_iov_t iov[3] =
+	{
+		{frame->buf, 3},
+		{frame->blk, DATA_SZ},
+		{&frame->buf[3 + DATA_SZ], 2},
+	};
+	return xport_writev(xp, iov, 3);
+}
+
+static int xmodem_rsp_write(struct xport_t* xp, const unsigned char ch, const uint8_t pkt_num)
+{
+	//i.e. with a window, ACK and NAK name the block they answer, as in SEAlink
+	const unsigned char rsp[3] = {ch, pkt_num, (uint8_t)(255 - pkt_num)};
+	return (xport_write(xp, rsp, sizeof(rsp)) == (int)sizeof(rsp))?(0):(-1);
+}
+
+struct xmodem_window_t
+{
+	struct xmodem_frame_t frame[XMODEM_WINDOW_MAX]; //i.e. block k stays encoded in slot k % XMODEM_WINDOW_MAX until its ACK
+	uint64_t ts[XMODEM_WINDOW_MAX];  //i.e. when the frame was expected on the wire the last time it was sent
+	short retry[XMODEM_WINDOW_MAX];
+	bool is_acked[XMODEM_WINDOW_MAX];
+	bool is_retried[XMODEM_WINDOW_MAX]; //i.e. Karn's algorithm, per frame
+	uint8_t base;   //i.e. the oldest block not ACKed
+	short cnt;      //i.e. blocks in flight from base on
+	bool is_eof;
+	bool is_resent; //i.e. late responses may follow the last ACK
+	unsigned char rsp[3];
+	size_t rsp_len;
+	short can_cnt; //i.e. a block number may read as CAN once a response lost a byte, so two in a row are needed
+};
+
+static void xmodem_window_reset(struct xmodem_window_t* win, const uint8_t base)
+{
+	int k = 0;
+	for(k = 0; k < XMODEM_WINDOW_MAX; k++)
+	{
+		win->is_acked[k] = false;
+		win->is_retried[k] = false;
+	}
+	win->base = base;
+	win->cnt = 0;
+	win->is_eof = false;
+	win->is_resent = false;
+	win->rsp_len = 0;
+	win->can_cnt = 0;
+}
+
+static int xmodem_window_send(struct xport_t* xp, struct xmodem_window_t* win, const uint8_t pkt_num, const struct xmodem_timeout_t* to, uint64_t* wire_idle_us)
+{
+	//i.e. a frame queues behind those written before it, so its time-out runs from when it should be on the wire
+	const int slot = pkt_num % XMODEM_WINDOW_MAX;
+	const struct xmodem_frame_t* frame = &win->frame[slot];
+	uint64_t now = xport_now_us();
+	win->ts[slot] = (*wire_idle_us > now)?(*wire_idle_us):(now);
+	*wire_idle_us = win->ts[slot] + to->byte_us * (frame->data_sz + 5); //i.e. 128-byte and 1K frames may share the window
+	return (xmodem_frame_write(xp, frame) == (int)(frame->data_sz + 5))?(0):(-1);
+}
+
+static unsigned char xmodem_window_rsp(struct xmodem_window_t* win, const unsigned char ch, uint8_t* pkt_num)
+{
+	//i.e. 0 until a response is complete, a damaged one is dropped and the next ACK or NAK starts over
+	if(win->rsp_len == 0)
+	{
+		if(ch == XMODEM_ACK || ch == XMODEM_NAK)
+		{
+			win->rsp[win->rsp_len++] = ch;
+		}
+		win->can_cnt = (ch == XMODEM_CAN_HDR)?(win->can_cnt + 1):(0);
+		return (win->can_cnt >= 2)?(XMODEM_CAN_HDR):(0);
+	}
+	win->can_cnt = 0;
+	if(win->rsp_len == 1)
+	{
+		win->rsp[win->rsp_len++] = ch;
+		return 0;
+	}
+	win->rsp_len = 0;
+	if((uint8_t)(win->rsp[1] + ch) == 0xff)
+	{
+		*pkt_num = win->rsp[1];
+		return win->rsp[0];
+	}
+	if(ch == XMODEM_ACK || ch == XMODEM_NAK)
+	{
+		win->rsp[win->rsp_len++] = ch;
+	}
+	return 0;
+}
+
+enum xmodem_rx_evt_t
+{
+	xmodem_rx_evt_more = 0, //i.e. the frame is not complete yet
+	xmodem_rx_evt_frame,    //i.e. the next block, intact
+	xmodem_rx_evt_dup,      //i.e. the last block again, its ACK was lost
+	xmodem_rx_evt_bad_crc,  //i.e. the block or its number is damaged
+	xmodem_rx_evt_bad_seq,  //i.e. an intact block out of sequence, one is missing
+};
+
+struct xmodem_rx_t
+{
+	uint8_t buf[sizeof(struct xmodem_1k_pkt_t)]; //i.e. the frame as it arrives, its block is at &buf[3]
+	size_t data_sz;       //i.e. from the header, 0 while no frame is being received
+	size_t len;           //i.e. bytes of the frame so far
+	uint16_t crc16;       //i.e. of the block bytes so far, so the check is done once the trailer arrives
+	uint8_t pkt_num_last; //i.e. of the last accepted block
+	bool verbose;         //i.e. of the session, a reset leaves it alone
 };
 
-static int data_block_release(struct data_block_t** root)
+static void xmodem_rx_reset(struct xmodem_rx_t* rx)
+{
+	rx->data_sz = 0;
+	rx->len = 0;
+	rx->crc16 = 0;
+	rx->pkt_num_last = 0;
+}
+
+static int xmodem_rx_start(struct xmodem_rx_t* rx, const uint8_t hdr)
+{
+	//i.e. -1 means hdr is not the header of a data frame
+	switch(hdr)
+	{
+		case XMODEM_1K_HDR: rx->data_sz = XMODEM_1K_DATA_SZ; break;
+		case XMODEM_CRC_HDR: rx->data_sz = XMODEM_CRC_DATA_SZ; break;
+		default: rx->data_sz = 0; return -1;
+	}
+	rx->buf[0] = hdr;
+	rx->len = 1;
+	rx->crc16 = 0;
+	return 0;
+}
+
+static size_t xmodem_rx_want(struct xmodem_rx_t* rx, uint8_t** dst)
+{
+	//i.e. where the rest of the frame goes, so a port can be read straight into place
+	*dst = &rx->buf[rx->len];
+	return rx->data_sz + 5 - rx->len;
+}
+
+static inline __attribute__((always_inline)) enum xmodem_rx_evt_t xmodem_rx_feed_sz(struct xmodem_rx_t* rx, const uint8_t* span, const size_t SPAN_SZ, size_t* used, const size_t DATA_SZ)
 {
-	if(root == NULL)
+	//NOTE: DATA_SZ is a constant at each call site, so every block size gets its own copy of this parser
+	const size_t FRAME_SZ = DATA_SZ + 5;
+	size_t cnt = FRAME_SZ - rx->len;
+	if(cnt > SPAN_SZ)
+	{
+		cnt = SPAN_SZ;
+	}
+	if(span != &rx->buf[rx->len])
+	{
+		memcpy(&rx->buf[rx->len], span, cnt);
+	}
+	//i.e. the CRC runs over the part of the span inside the block
+	size_t lo = (rx->len > 3)?(rx->len):(3);
+	size_t hi = (rx->len + cnt < 3 + DATA_SZ)?(rx->len + cnt):(3 + DATA_SZ);
+	if(hi > lo)
+	{
+		rx->crc16 = crc16_update(rx->crc16, &rx->buf[lo], hi - lo);
+	}
+	rx->len += cnt;
+	*used = cnt;
+	if(rx->len < FRAME_SZ)
 	{
-		return -1;
+		return xmodem_rx_evt_more;
 	}
-	struct data_block_t* iter = *root;
-	while(iter != NULL)
+	rx->data_sz = 0;
+	const uint8_t pkt_num_l = rx->buf[1];
+	const uint8_t pkt_num_h = rx->buf[2];
+	const uint16_t crc16 = (uint16_t)(rx->buf[3 + DATA_SZ] << 8) | rx->buf[4 + DATA_SZ];
+	xmodem_printf(rx->verbose, "[%s] pkt_num_l = %u, pkt_num_h = %u, crc16 = 0x%04x (0x%04x) within %u\n", __FUNCTION__, pkt_num_l, pkt_num_h, crc16, rx->crc16, (unsigned int)DATA_SZ);
+	if(crc16 != rx->crc16 || (uint8_t)(pkt_num_l + pkt_num_h) != 0xff)
 	{
-		struct data_block_t* temp = iter->next;
-		//xmodem_printf("data = %p, itself = %p\n", iter->data, iter);
-		free(iter->data);
-		free(iter);
-		iter = temp;
+		return xmodem_rx_evt_bad_crc;
 	}
-	*root = NULL;
-	return 0;
-}
-
-static int data_block_append(struct data_block_t** root, struct data_block_t** last, unsigned char* data, size_t data_sz)
-{
-	struct data_block_t* newborn = NULL;
-	do
+	if((uint8_t)(rx->pkt_num_last + 1) == pkt_num_l)
 	{
-		if(root == NULL || last == NULL || data == NULL || data_sz == 0)
-		{
-			break;
-		}
-		newborn = (struct data_block_t*)malloc(sizeof(struct data_block_t));
-		if(newborn == NULL)
-		{
-			break;
-		}
-		newborn->data = (unsigned char*)malloc(sizeof(unsigned char) * data_sz);
-		if(newborn->data == NULL)
-		{
-			break;
-		}
-		memcpy(newborn->data, data, data_sz);
-		newborn->data_sz = data_sz;
-		newborn->next = NULL;
-		//xmodem_printf("data = %p, itself = %p\n", newborn->data, newborn);
-
-		if(*root == NULL)
-		{
-			*root = newborn;
-			*last = newborn;
-		}
-		else
-		{
-			(*last)->next = newborn;
-			*last = newborn;
-		}
-		return 0;
-	} while(0);
-	if(newborn != NULL)
+		rx->pkt_num_last = pkt_num_l;
+		return xmodem_rx_evt_frame;
+	}
+	if(rx->pkt_num_last == pkt_num_l)
 	{
-		if(newborn->data != NULL)
-		{
-			free(newborn->data);
-		}
-		free(newborn);
+		xmodem_printf(rx->verbose, "[%s] duplicate, pkt_num_l = %u (%u)\n", __FUNCTION__, pkt_num_l, rx->pkt_num_last);
+		return xmodem_rx_evt_dup;
 	}
-	return -1;
+	xmodem_printf(rx->verbose, "[%s] out of sequence, pkt_num_l = %u (%u)\n", __FUNCTION__, pkt_num_l, rx->pkt_num_last);
+	return xmodem_rx_evt_bad_seq;
 }
 
-static void data_block_dump(struct data_block_t* root) __attribute__((unused));
-static void data_block_dump(struct data_block_t* root)
+static enum xmodem_rx_evt_t xmodem_rx_feed(struct xmodem_rx_t* rx, const uint8_t* span, const size_t SPAN_SZ, size_t* used)
 {
-	int num = 0;
-	struct data_block_t* iter = root;
-	while(iter != NULL)
+	switch(rx->data_sz)
 	{
-		xmodem_printf("[%u] iter[%d] = %p\n", __LINE__, num, iter);
-		iter = iter->next;
-		num++;
+		case XMODEM_1K_DATA_SZ: return xmodem_rx_feed_sz(rx, span, SPAN_SZ, used, XMODEM_1K_DATA_SZ);
+		case XMODEM_CRC_DATA_SZ: return xmodem_rx_feed_sz(rx, span, SPAN_SZ, used, XMODEM_CRC_DATA_SZ);
+		default: *used = 0; return xmodem_rx_evt_more;
 	}
 }
 
-static int data_block_load(struct data_block_t** root, const char* fn, const size_t data_sz)
+struct xmodem_rx_window_t
+{
+	uint8_t data[XMODEM_WINDOW_MAX][XMODEM_1K_DATA_SZ]; //i.e. blocks which arrived ahead of a missing one, block k in slot k % XMODEM_WINDOW_MAX
+	size_t data_sz[XMODEM_WINDOW_MAX]; //i.e. 0 for an empty slot
+	uint8_t front; //i.e. the block after the highest one seen, each missing one below it has been NAKed once
+};
+
+static void xmodem_rx_window_reset(struct xmodem_rx_window_t* rxw, const uint8_t pkt_num_next)
+{
+	memset(rxw->data_sz, 0, sizeof(rxw->data_sz));
+	rxw->front = pkt_num_next;
+}
+
+static int xmodem_rx_store(struct xmodem_rx_snk_t* rs, const uint8_t* data, const size_t DATA_SZ, uint64_t* remain, short* pad_cnt)
 {
-	FILE* fp = NULL;
-	do
+	//i.e. with the length known, the padding of the last block never reaches the file
+	if(rs->is_probed == false)
 	{
-		if(root == NULL || fn == NULL)
-		{
-			break;
-		}
-		if(*root != NULL)
-		{
-			break;
-		}
-		fp = fopen(fn, "rb");
-		if(fp == NULL)
-		{
-			xmodem_printf("[%s] error!\n", __FUNCTION__);
-			break;
-		}
-		struct data_block_t* last = NULL;
-		size_t rret = 0;
-		bool err = false;
-		do
+		//i.e. a compressed file starts with the container header, whose CRC keeps a plain file from passing for one
+		uint64_t orig_len = 0;
+		rs->is_probed = true;
+		if(lz_probe(data, DATA_SZ, &orig_len) == 1)
 		{
-			struct data_block_t* newborn = (struct data_block_t*)malloc(sizeof(struct data_block_t));
-			if(newborn == NULL)
-			{
-				err = true;
-				break;
-			}
-			newborn->data = (unsigned char*)malloc(sizeof(unsigned char) * data_sz);
-			if(newborn->data == NULL)
-			{
-				err = true;
-				break;
-			}
-			rret = fread(newborn->data, sizeof(unsigned char), data_sz, fp);
-			if(rret > 0)
-			{
-				if(rret < data_sz)
-				{
-					memset(&newborn->data[rret], XMODEM_PAD, data_sz - rret);
-					rret = 0;
-				}
-				newborn->data_sz = data_sz;
-				newborn->next = NULL;
-				if(*root == NULL)
-				{
-					*root = newborn;
-				}
-				else
-				{
-					last->next = newborn;
-				}
-				last = newborn;
-			}
-			else if(rret == 0)
+			rs->dec = lz_dec_open(xmodem_sink_lz_write, rs);
+			if(rs->dec == NULL)
 			{
-				free(newborn->data);
-				free(newborn);
+				return -1;
 			}
-		} while(rret > 0); //!feof(fp) would be okay too
-		fclose(fp);
-		if(err == true)
-		{
-			(void)data_block_release(root);
-			return -1;
+			xmodem_printf(rs->verbose, "[%s] fn = %s, compressed, size = %llu\n", __FUNCTION__, rs->fn, (unsigned long long)orig_len);
+			*remain = UINT64_MAX; //i.e. the container ends itself, the length in block 0 is the original one
 		}
-		return 0;
-	} while(0);
-	if(fp != NULL)
+	}
+	if(rs->dec != NULL)
+	{
+		*pad_cnt = 0;
+		return lz_dec_write(rs->dec, data, DATA_SZ);
+	}
+	size_t cnt = ((uint64_t)DATA_SZ < *remain)?(DATA_SZ):((size_t)*remain);
+	if(xmodem_sink_append(rs, data, cnt) != 0)
 	{
-		fclose(fp);
+		return -1;
 	}
-	(void)data_block_release(root);
-	return -1;
+	*remain -= (*remain == UINT64_MAX)?(0):(cnt);
+	*pad_cnt = (*remain == UINT64_MAX)?(xmodem_pad_count(data, DATA_SZ)):(0);
+	return 0;
 }
 
-static int data_block_store(struct data_block_t** root, const char* fn)
+static int xmodem_read_until(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ, const uint64_t deadline)
 {
-	int ret = -1;
-
-	if(root == NULL || fn == NULL)
+	//i.e. 0 means nothing arrived before the deadline (or the wait was interrupted)
+	int rret = xport_read(xp, buf, BUF_SZ);
+	if(rret != 0)
 	{
-		xmodem_printf("[%s] error!\n", __FUNCTION__);
+		return rret;
 	}
-	else
+	int wret = xport_wait(xp, deadline);
+	if(wret <= 0)
 	{
-		FILE* fp = fopen(fn, "wb+");
-		if(fp != NULL)
-		{
-			size_t cnt = 0;
-			struct data_block_t* iter = *root;
-			while(iter != NULL)
-			{
-				if(iter->next == NULL)
-				{
-					//i.e. last one
-					short pad_cnt = 0;
-					size_t j = 0;
-					for(j = iter->data_sz - 1; j > 0; j--)
-					{
-						if(iter->data[j] == XMODEM_PAD)
-						{
-							pad_cnt++;
-						}
-						else
-						{
-							break;
-						}
-					}
-					if(pad_cnt > 0)
-					{
-						xmodem_printf("[%s] warning: fn = %s, pad_cnt = %d\n", __FUNCTION__, fn, pad_cnt);
-					}
-				}
-				size_t wret = fwrite(iter->data, sizeof(unsigned char), iter->data_sz, fp);
-				if(wret != iter->data_sz)
-				{
-					xmodem_printf("[%s] error!\n", __FUNCTION__);
-					break;
-				}
-				iter = iter->next;
-				cnt++;
-			}
-			fflush(fp);
-			fclose(fp);
-			(void)data_block_release(root);
-			xmodem_printf("[%s] cnt = %u\n", __FUNCTION__, (unsigned int)cnt);
-			ret = 0;
-		}
-		else
-		{
-			xmodem_printf("[%s] error!\n", __FUNCTION__);
-		}
+		return wret;
 	}
-
-	return ret;
+	return xport_read(xp, buf, BUF_SZ);
 }
 
-static int data_block_iterate(struct data_block_t** root, struct data_block_t** iter, struct data_block_t** curr)
+static int xmodem_read_full(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ, const uint64_t deadline)
 {
-	int ret = -1;
-	do
+	//i.e. the bytes read before the deadline, which are fewer than BUF_SZ only on a time-out
+	size_t done = 0;
+	while(done < BUF_SZ)
 	{
-		if(root == NULL || iter == NULL || curr == NULL)
-		{
-			break;
-		}
-		if(*iter == NULL)
+		int rret = xmodem_read_until(xp, &buf[done], BUF_SZ - done, deadline);
+		if(rret < 0)
 		{
-			*curr = *root;
-			*iter = (*root)->next;
+			return -1;
 		}
-		else
+		if(rret == 0 && xport_now_us() >= deadline)
 		{
-			*curr = *iter;
-			*iter = (*iter)->next;
+			break;
 		}
-	} while(0);
-	return ret;
+		done += rret;
+	}
+	return (int)done;
 }
 
-static int data_block_has_next(struct data_block_t** root, struct data_block_t** iter)
+static void xmodem_purge(struct xport_t* xp, const struct xmodem_timeout_t* to)
 {
-	int ret = 0;
-	do
+	//i.e. drop the rest of a broken frame until the line is quiet, bounded by one frame time-out
+	unsigned char buf[256] = {0x0};
+	const uint64_t limit = xport_now_us() + to->ack_us;
+	while(xport_now_us() < limit)
 	{
-		if(root == NULL || iter == NULL)
+		int rret = xmodem_read_until(xp, buf, sizeof(buf), xport_now_us() + to->purge_us);
+		if(rret <= 0)
 		{
 			break;
 		}
-		if(*iter != NULL)
-		{
-			ret = !(0);
-		}
-	} while(0);
-	return ret;
-}
-
-static int data_block_is_empty(struct data_block_t* curr)
-{
-	int ret = (curr != NULL)?(0):(!(0));
-	return ret;
+	}
 }
 
-static void data_block_copy(uint8_t* data, struct data_block_t* curr)
+static int xmodem_receive_files(struct xmodem_session_t* xs, const char* fnrcv, const bool is_batch, struct xmodem_stripe_t* stripe, const struct xmodem_sink_t* out)
 {
-	memcpy(data, curr->data, curr->data_sz);
-}
-
-static uint16_t crc_calculate(uint8_t *ptr, short count)
-{
-	//CCITT
-    uint16_t crc;
-    uint8_t i;
-
-    crc = 0;
-    while (--count >= 0)
-    {
-        crc = crc ^ (int) *ptr++ << 8;
-        i = 8;
-        do
-        {
-            if (crc & 0x8000)
-                crc = crc << 1 ^ 0x1021;
-            else
-                crc = crc << 1;
-        } while(--i);
-    }
-    return (crc);
-}
-
-int xmodem_receive(const HANDLE hComm, const short ind_time, const char* fnrcv, xmodem_keep_xfer_cb keep_xfer_cb)
-{
-	const char* fn = (fnrcv == NULL || strlen(fnrcv) == 0)?("default_out.txt"):(fnrcv);
-	struct data_block_t* dbrcv = NULL;
-	xmodem_printf("[%s] hComm = 0x%p (%s)\n", __FUNCTION__, hComm, hComm==INVALID_HANDLE_VALUE?"abnormal":"normal");
-	SYSTEMTIME tsBegin = {0};
-	GetSystemTime(&tsBegin);
-	struct xmodem_crc_pkt_t xcp = {0x0};
-	struct xmodem_1k_pkt_t x1p = {0x0};
-	struct data_block_t* dblast = NULL;
-	short ind_retry_count = 0;
-	short pkt_xfer_retry_count = 0;
-	short pkt_num_index = 0;
-	short data_index = 0;
-	short crc16_index = 0;
-	bool is_xmodem_1k = false;
+	//i.e. with out, a single file goes to the caller and fnrcv only names it in the log
+	struct xport_t* xp = xs->xp;
+	const short ind_time = xs->ind_time;
+	xmodem_keep_xfer_cb* keep_xfer_cb = xs->keep_xfer_cb;
+	const char* fn = (fnrcv == NULL || strlen(fnrcv) == 0)?((is_batch == true)?("."):("default_out.txt")):(fnrcv);
+	struct xmodem_rx_snk_t rs = {.snk = NULL, .out = out, .dec = NULL, .is_probed = false, .is_shared = false, .offset = 0, .fn = NULL, .ckpt = NULL, .stored = &xs->rx_bytes, .verbose = xs->verbose};
+	struct xmodem_stripe_t seg; //i.e. from block 0, cnt is 0 for a file sent whole
+	memset(&seg, 0, sizeof(seg));
+	char path[260] = {'\0'}; //i.e. of the file being received, in batch mode fn is its directory
+	uint64_t remain = UINT64_MAX; //i.e. bytes of the file still to be written, known from block 0 only
+	long long mtime = -1;
+	bool is_hdr_due = is_batch; //i.e. block 0 is expected next
+	const bool is_stream = (xs->flags & XMODEM_FLAG_STREAM)?(true):(false);
+	struct xmodem_rx_window_t* rxw = NULL; //i.e. only with a window, where blocks may arrive ahead of a missing one
+	int rsp_num = -1; //i.e. the block named by the next ACK, -1 for a plain one
+	strncpy(path, fn, sizeof(path) - sizeof(char));
+	//i.e. a single file can resume, its checkpoint is kept while the data is stored and written when the transfer fails
+	const bool is_resume = ((xs->flags & XMODEM_FLAG_RESUME) != 0 && is_batch == false && out == NULL)?(true):(false);
+	struct xmodem_ckpt_t ckpt_run = {.offset = 0, .hash = XMODEM_HASH_INIT};
+	struct xmodem_ckpt_t ckpt_held = {.offset = 0, .hash = XMODEM_HASH_INIT};
+	rs.fn = path;
+	rs.ckpt = (is_resume == true)?(&ckpt_run):(NULL);
+	short offer_cnt = (is_resume == true && xmodem_ckpt_load(path, &ckpt_held, xs->verbose) == 0)?(XMODEM_RESUME_OFFER_CNT):(0);
+	bool is_offering = false; //i.e. the checkpoint was offered and the answer of the transmitter is due
+	bool is_resumed = false;
+	short pad_cnt = 0; //i.e. of the last accepted block
+	xmodem_printf(xs->verbose, "[%s] xp = %p (%s)\n", __FUNCTION__, xp, xp==NULL?"abnormal":xp->ops->name);
+	if(xp != NULL)
+	{
+		xp->tx_timeout_us = ms_to_us(ind_time * 1000); //i.e. a link which stays full for the waiting time has lost its peer
+	}
+	xs->rx_bytes = 0;
+	uint64_t tsBegin = xport_now_us();
+	struct xmodem_rx_t rx;
+	xmodem_rx_reset(&rx);
+	rx.verbose = xs->verbose;
+	if(is_batch == true)
+	{
+		rx.pkt_num_last = 0xff; //i.e. so block 0 is the next one
+	}
+	if(xs->window > 0 && is_stream == false)
+	{
+		rxw = (struct xmodem_rx_window_t*)calloc(1, sizeof(struct xmodem_rx_window_t));
+		if(rxw == NULL)
+		{
+			return -1;
+		}
+		xmodem_rx_window_reset(rxw, (uint8_t)(rx.pkt_num_last + 1));
+	}
+	uint64_t ind_deadline = 0;
+	uint64_t deadline = 0;
+	short pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
+	struct xmodem_timeout_t to = {0};
+	xmodem_timeout_calc(&to, xs, sizeof(struct xmodem_1k_pkt_t)); //NOTE: the size of the next frame is unknown, so the larger one is assumed
+	xmodem_rtt_reset(&xs->rtt, &to);
+	uint64_t ts_rsp = 0;
+	short can_cnt = 0;
+	bool is_eot_naked = false; //i.e. with a window, the first EOT of a file was NAKed and only a repeated one ends it
 	unsigned char ch = 0x0;
 	enum xmodem_state_t state_curr = xmodem_state_initial;
 	enum xmodem_state_t state_prev = xmodem_state_initial;
+	enum xmodem_state_t cached_state_prev = xmodem_state_initial; //i.e. as last printed
+	enum xmodem_state_t cached_state_curr = xmodem_state_initial;
 	while(state_curr != xmodem_state_success && state_curr != xmodem_state_failure)
 	{
-		static enum xmodem_state_t cached_state_prev = xmodem_state_initial;
 		if(cached_state_prev != state_prev)
 		{
-			xmodem_printf("[%s] state_prev = %s\n", __FUNCTION__, xmodem_state_s[state_prev]);
+			xmodem_printf(xs->verbose, "[%s] state_prev = %s\n", __FUNCTION__, xmodem_state_s[state_prev]);
 			cached_state_prev = state_prev;
 		}
-		static enum xmodem_state_t cached_state_curr = xmodem_state_initial;
 		if(cached_state_curr != state_curr)
 		{
-			xmodem_printf("[%s] state_curr = %s\n", __FUNCTION__, xmodem_state_s[state_curr]);
+			xmodem_printf(xs->verbose, "[%s] state_curr = %s\n", __FUNCTION__, xmodem_state_s[state_curr]);
 			cached_state_curr = state_curr;
 		}
 
@@ -436,13 +1292,30 @@ int xmodem_receive(const HANDLE hComm, const short ind_time, const char* fnrcv,
 			case xmodem_state_initial:
 			{
 				state_curr = xmodem_state_indicate;
-				ind_retry_count = ind_time*XMODEM_INDICATE_MULTIPLICATION;
+				ind_deadline = xport_now_us() + ms_to_us(ind_time * 1000);
 			}
 			break;
 			case xmodem_state_indicate:
 			{
-				ch = XMODEM_CRC_IND;
-				(void)sp_write(hComm, (unsigned char*)&ch, sizeof(ch));
+				if(is_resume == true && is_resumed == false)
+				{
+					//i.e. the checkpoint is offered until it is answered, then (or without one) an offer of nothing makes a transmitter start over
+					uint8_t offer[XMODEM_RESUME_OFFER_SZ] = {0x0};
+					xmodem_resume_build(offer, (offer_cnt > 0)?(&ckpt_held):(&ckpt_run));
+					(void)xport_write(xp, offer, sizeof(offer));
+					is_offering = (offer_cnt > 0)?(true):(false);
+					offer_cnt -= (offer_cnt > 0)?(1):(0);
+				}
+				if(is_offering == false)
+				{
+					ch = (is_stream == true)?(XMODEM_G_IND):((rxw != NULL)?(XMODEM_W_IND):(XMODEM_CRC_IND));
+					(void)xport_write(xp, (unsigned char*)&ch, sizeof(ch));
+				}
+				deadline = xport_now_us() + ms_to_us(XMODEM_INDICATE_INTERVAL);
+				if(deadline > ind_deadline)
+				{
+					deadline = ind_deadline;
+				}
 				state_prev = state_curr;
 				state_curr = xmodem_state_wait;
 			}
@@ -454,8 +1327,8 @@ int xmodem_receive(const HANDLE hComm, const short ind_time, const char* fnrcv,
 					state_curr = xmodem_state_can_xmt;
 					continue;
 				}
-				int rret = sp_read(hComm, &ch, sizeof(ch));
-				//xmodem_printf("[%s] rret = %d, ch = 0x%02x\n", __FUNCTION__, rret, (unsigned char)ch);
+				int rret = xmodem_read_until(xp, &ch, sizeof(ch), deadline);
+				//xmodem_printf(xs->verbose, "[%s] rret = %d, ch = 0x%02x\n", __FUNCTION__, rret, (unsigned char)ch);
 				if(rret < 0)
 				{
 					state_curr = xmodem_state_failure;
@@ -466,300 +1339,394 @@ int xmodem_receive(const HANDLE hComm, const short ind_time, const char* fnrcv,
 					{
 						case xmodem_state_indicate:
 						{
-							if(ind_retry_count == 0)
+							if(xport_now_us() >= ind_deadline)
 							{
 								state_curr = xmodem_state_failure;
 							}
-							else
+							else if(xport_now_us() >= deadline)
 							{
-								ind_retry_count--;
-								if((ind_retry_count % XMODEM_INDICATE_MULTIPLICATION) == 0)
-								{
-									state_curr = xmodem_state_indicate;
-								}
-								else
-								{
-									msleep(XMODEM_INDICATE_TIMEOUT);
-								}
+								state_curr = xmodem_state_indicate;
 							}
 						}
 						break;
 						case xmodem_state_ack_xmt:
 						case xmodem_state_nak_xmt:
 						{
-							if(pkt_xfer_retry_count == 0)
+							if(xport_now_us() >= deadline)
 							{
-								state_curr = xmodem_state_failure;
+								xmodem_rtt_backoff(&xs->rtt);
+								state_curr = xmodem_state_nak_xmt;
 							}
-							else
+						}
+						break;
+						case xmodem_state_frame_rcv:
+						{
+							//i.e. streaming, the next frame is overdue and nothing would be resent
+							if(xport_now_us() >= deadline)
 							{
-								pkt_xfer_retry_count--;
-								msleep(XMODEM_PKT_XFER_TIMEOUT);
+								state_curr = xmodem_state_can_xmt;
 							}
 						}
 						break;
 						default:
 						{
-							//do nothing
+							//i.e. keep waiting
+							if(xport_now_us() >= deadline)
+							{
+								deadline = xport_now_us() + xmodem_rtt_idle(&xs->rtt, &to);
+							}
 						}
 						break;
 					}
 				}
 				else
 				{
-					pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
-					switch(ch)
+					deadline = xport_now_us() + to.ack_us;
+					if(state_prev == xmodem_state_ack_xmt)
 					{
-						case XMODEM_1K_HDR:
+						//i.e. turnaround of the transmitter, from our ACK to its next frame
+						xmodem_rtt_sample(&xs->rtt, xport_now_us() - ts_rsp);
+					}
+					can_cnt = (ch == XMODEM_CAN_HDR)?(can_cnt + 1):(0);
+					if(is_offering == true && (ch == XMODEM_ACK || ch == XMODEM_NAK))
+					{
+						//i.e. the transmitter has moved its file to the end of ours (ACK), or it found the prefix differs (NAK)
+						is_offering = false;
+						offer_cnt = 0;
+						state_curr = xmodem_state_indicate;
+						if(ch == XMODEM_NAK)
 						{
-							state_curr = xmodem_state_hdr_rcv;
-							x1p.hdr = ch;
-							pkt_num_index = 0;
-							is_xmodem_1k = true;
+							xmodem_printf(xs->verbose, "[%s] fn = %s, resume is refused, the file starts over\n", __FUNCTION__, path);
+							continue;
 						}
-						break;
+						rs.snk = stream_snk_open_at(path, ckpt_held.offset, xs->verbose);
+						if(rs.snk == NULL)
+						{
+							state_curr = xmodem_state_can_xmt;
+							continue;
+						}
+						xmodem_printf(xs->verbose, "[%s] fn = %s, resume at offset = %llu\n", __FUNCTION__, path, (unsigned long long)ckpt_held.offset);
+						ckpt_run = ckpt_held;
+						is_resumed = true;
+						continue;
+					}
+					switch(ch)
+					{
+						case XMODEM_1K_HDR:
 						case XMODEM_CRC_HDR:
 						{
-							state_curr = xmodem_state_hdr_rcv;
-							xcp.hdr = ch;
-							pkt_num_index = 0;
-							is_xmodem_1k = false;
+							//NOTE: a transmitter which knows nothing of resuming may take a byte of the offer for an indication
+							is_offering = false;
+							offer_cnt = 0;
+							is_eot_naked = false; //i.e. the transmitter is not done, so an EOT before was noise
+							(void)xmodem_rx_start(&rx, ch);
+							state_curr = xmodem_state_frame_rcv;
 						}
 						break;
 						case XMODEM_EOT_HDR:
 						{
-							state_prev = xmodem_state_wait_term;
-							state_curr = xmodem_state_ack_xmt;
+							//i.e. a real EOT is followed by silence, otherwise it is a payload byte behind a lost header
+							//NOTE: with a window, a block held beyond a missing one is unanswered, so the transmitter cannot be done, and a full window is silent too
+							const bool is_held = (rxw != NULL && is_hdr_due == false && rxw->front != (uint8_t)(rx.pkt_num_last + 1))?(true):(false);
+							unsigned char next = 0x0;
+							int qret = xmodem_read_until(xp, &next, sizeof(next), xport_now_us() + to.purge_us);
+							if(qret == 0 && is_held == true)
+							{
+								xmodem_printf(xs->verbose, "[%s] EOT with blocks held up to %u, taken for noise\n", __FUNCTION__, (unsigned int)(uint8_t)(rxw->front - 1));
+							}
+							else if(qret == 0 && rxw != NULL && is_hdr_due == false && is_eot_naked == false)
+							{
+								//i.e. with a window the payload is searched for a header, where a stray EOT may be followed by a silent full window
+								//NOTE: a plain NAK, the transmitter which is done sends the EOT again, and one in the middle of a window drops it as a damaged response
+								xmodem_printf(xs->verbose, "[%s] EOT after pkt_num = %u, NAKed until it is repeated\n", __FUNCTION__, (unsigned int)rx.pkt_num_last);
+								is_eot_naked = true;
+								ch = XMODEM_NAK;
+								(void)xport_write(xp, (unsigned char*)&ch, sizeof(ch));
+								ts_rsp = xport_now_us();
+								deadline = ts_rsp + xmodem_rtt_idle(&xs->rtt, &to);
+							}
+							else if(qret == 0 && is_batch == true)
+							{
+								//i.e. the file is complete, then block 0 of the next one is asked for
+								//NOTE: an EOT again, as its ACK was lost, is only answered
+								if(is_hdr_due == false)
+								{
+									is_eot_naked = false;
+									if(xmodem_sink_finish(&rs, mtime) != 0)
+									{
+										xmodem_printf(xs->verbose, "[%s] fn = %s, write error!\n", __FUNCTION__, path);
+										state_curr = xmodem_state_can_xmt;
+										continue;
+									}
+									xmodem_printf(xs->verbose, "[%s] fn = %s, done\n", __FUNCTION__, path);
+									is_hdr_due = true;
+									rx.pkt_num_last = 0xff;
+								}
+								state_prev = xmodem_state_wait_file;
+								state_curr = xmodem_state_ack_xmt;
+							}
+							else if(qret == 0)
+							{
+								state_prev = xmodem_state_wait_term;
+								state_curr = xmodem_state_ack_xmt;
+							}
+							else if(rxw == NULL)
+							{
+								state_curr = xmodem_state_nak_xmt;
+							}
 						}
 						break;
 						case XMODEM_CAN_HDR:
 						{
-							state_prev = xmodem_state_wait_canc;
-							state_curr = xmodem_state_ack_xmt;
+							//i.e. two in a row are needed, a single one may be line noise
+							//NOTE: and silence after them, as the payload searched for the next header may hold two as well
+							if(can_cnt >= 2)
+							{
+								unsigned char next = XMODEM_CAN_HDR;
+								int qret = 1;
+								while(qret > 0 && (next == XMODEM_CAN_HDR || next == XMODEM_BS))
+								{
+									qret = xmodem_read_until(xp, &next, sizeof(next), xport_now_us() + to.purge_us);
+								}
+								can_cnt = 0;
+								if(qret == 0)
+								{
+									state_prev = xmodem_state_wait_canc;
+									state_curr = xmodem_state_ack_xmt;
+								}
+								else if(qret < 0)
+								{
+									state_curr = xmodem_state_failure;
+								}
+							}
 						}
+						break;
 						default:
 						{
-							//do nothing
+							//NOTE: with a window, the frames behind it are still good, so the line is only searched for the next header
+							if(state_prev != xmodem_state_indicate && rxw == NULL)
+							{
+								//i.e. the header is lost, so the rest of the frame is purged and NAKed
+								state_curr = xmodem_state_nak_xmt;
+							}
 						}
 						break;
 					}
 				}
 			}
 			break;
-			case xmodem_state_hdr_rcv:
-			{
-				int rret = sp_read(hComm, &ch, sizeof(ch));
-				if(rret < 0)
-				{
-					state_curr = xmodem_state_failure;
-				}
-				else if(rret == 0)
-				{
-					if(pkt_xfer_retry_count == 0)
-					{
-						state_curr = xmodem_state_failure;
-					}
-					else
-					{
-						pkt_xfer_retry_count--;
-						msleep(XMODEM_PKT_XFER_TIMEOUT);
-					}
-				}
-				else
-				{
-					pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
-					if(is_xmodem_1k == true)
-					{
-						if(pkt_num_index == 0)
-						{
-							x1p.pkt_num_l = ch;
-						}
-						else
-						{
-							x1p.pkt_num_h = ch;
-						}
-					}
-					else
-					{
-						if(pkt_num_index == 0)
-						{
-							xcp.pkt_num_l = ch;
-						}
-						else
-						{
-							xcp.pkt_num_h = ch;
-						}
-					}
-					pkt_num_index++;
-					if(pkt_num_index >= (sizeof(uint8_t) + sizeof(uint8_t)))
-					{
-						data_index = 0;
-						state_curr = xmodem_state_pkt_num_rcv;
-					}
-				}
-			}
-			break;
-			case xmodem_state_pkt_num_rcv:
-			{
-				int rret = sp_read(hComm, &ch, sizeof(ch));
-				if(rret < 0)
-				{
-					state_curr = xmodem_state_failure;
-				}
-				else if(rret == 0)
-				{
-					if(pkt_xfer_retry_count == 0)
-					{
-						state_curr = xmodem_state_failure;
-					}
-					else
-					{
-						pkt_xfer_retry_count--;
-						msleep(XMODEM_PKT_XFER_TIMEOUT);
-					}
-				}
-				else
-				{
-					pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
-					if(is_xmodem_1k == true)
-					{
-						x1p.data[data_index] = ch;
-						data_index++;
-						if(data_index >= sizeof(x1p.data))
-						{
-							state_curr = xmodem_state_data_rcv;
-							crc16_index = 0;
-							x1p.crc16 = 0x0;
-						}
-					}
-					else
-					{
-						xcp.data[data_index] = ch;
-						data_index++;
-						if(data_index >= sizeof(xcp.data))
-						{
-							state_curr = xmodem_state_data_rcv;
-							crc16_index = 0;
-							xcp.crc16 = 0x0;
-						}
-					}
-				}
-			}
-			break;
-			case xmodem_state_data_rcv:
+			case xmodem_state_frame_rcv:
 			{
-				int rret = sp_read(hComm, &ch, sizeof(ch));
+				//i.e. the rest of the frame is read straight into the parser, in runs as the port delivers it
+				uint8_t* dst = NULL;
+				size_t want = xmodem_rx_want(&rx, &dst);
+				int rret = xmodem_read_until(xp, dst, want, deadline);
 				if(rret < 0)
 				{
 					state_curr = xmodem_state_failure;
 				}
 				else if(rret == 0)
 				{
-					if(pkt_xfer_retry_count == 0)
-					{
-						state_curr = xmodem_state_failure;
-					}
-					else
+					if(xport_now_us() >= deadline)
 					{
-						pkt_xfer_retry_count--;
-						msleep(XMODEM_PKT_XFER_TIMEOUT);
+						state_curr = xmodem_state_nak_xmt;
 					}
 				}
 				else
 				{
-					pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
-					if(is_xmodem_1k == true)
+					deadline = xport_now_us() + to.ack_us;
+					size_t used = 0;
+					switch(xmodem_rx_feed(&rx, dst, rret, &used))
 					{
-						x1p.crc16 |= ch << ((sizeof(x1p.crc16) - crc16_index - 1) * 8);
-						crc16_index++;
-						if(crc16_index >= sizeof(x1p.crc16))
+						case xmodem_rx_evt_frame:
 						{
-							uint16_t crc16 = crc_calculate(x1p.data, sizeof(x1p.data));
-							xmodem_printf("[%s] pkt_num_l = %u, pkt_num_h = %u, crc16 = 0x%04x (0x%04x) within %u\n", __FUNCTION__, (unsigned char)x1p.pkt_num_l, (unsigned char)x1p.pkt_num_h, x1p.crc16, crc16, (unsigned int)sizeof(x1p.data));
-							if(crc16 != x1p.crc16)
+							state_prev = state_curr;
+							state_curr = xmodem_state_ack_xmt;
+							const size_t DATA_SZ = rx.len - 5; //i.e. the frame is complete, so len is its size
+							if(is_hdr_due == true)
 							{
-								state_curr = xmodem_state_nak_xmt;
+								int hret = xmodem_hdr_parse(&rx.buf[3], DATA_SZ, fn, path, sizeof(path), &remain, &mtime, &seg);
+								if(hret < 0)
+								{
+									xmodem_printf(xs->verbose, "[%s] block 0 is unusable!\n", __FUNCTION__);
+									state_curr = xmodem_state_can_xmt;
+								}
+								else if(hret == 0)
+								{
+									state_prev = xmodem_state_wait_term; //i.e. the batch is over
+								}
+								else
+								{
+									xmodem_printf(xs->verbose, "[%s] fn = %s, size = %llu, mtime = %lld\n", __FUNCTION__, path, (unsigned long long)remain, mtime);
+									if(seg.cnt > 0)
+									{
+										xmodem_printf(xs->verbose, "[%s] fn = %s, segment %u of %u, offset = %llu, file size = %llu\n", __FUNCTION__, path, (unsigned int)seg.idx, (unsigned int)seg.cnt, (unsigned long long)seg.offset, (unsigned long long)seg.size);
+										(void)snprintf(seg.path, sizeof(seg.path), "%s", path);
+										rs.is_shared = true;
+										rs.offset = seg.offset;
+										if(stripe != NULL)
+										{
+											*stripe = seg;
+										}
+									}
+									if(rxw != NULL)
+									{
+										xmodem_rx_window_reset(rxw, 1);
+									}
+									is_hdr_due = false;
+									pad_cnt = 0;
+									state_prev = xmodem_state_wait_file;
+								}
+								break;
 							}
-							else if((x1p.pkt_num_l + x1p.pkt_num_h) != 0xff)
+							if(xmodem_rx_store(&rs, &rx.buf[3], DATA_SZ, &remain, &pad_cnt) != 0)
 							{
+								xmodem_printf(xs->verbose, "[%s] fn = %s, write error!\n", __FUNCTION__, path);
 								state_curr = xmodem_state_can_xmt;
 							}
-							else
+							else if(rxw != NULL)
 							{
-								state_prev = state_curr;
-								state_curr = xmodem_state_ack_xmt;
-
-								static uint8_t pkt_num_l_last = -1;
-								if(pkt_num_l_last != x1p.pkt_num_l)
+								//i.e. the blocks held behind this one follow it into the file
+								rsp_num = rx.buf[1];
+								int slot = (uint8_t)(rx.pkt_num_last + 1) % XMODEM_WINDOW_MAX;
+								while(rxw->data_sz[slot] > 0 && state_curr != xmodem_state_can_xmt)
 								{
-									int aret = data_block_append(&dbrcv, &dblast, x1p.data, sizeof(x1p.data));
-									if(aret != 0)
+									if(xmodem_rx_store(&rs, rxw->data[slot], rxw->data_sz[slot], &remain, &pad_cnt) != 0)
 									{
-										state_curr = xmodem_state_failure;
+										xmodem_printf(xs->verbose, "[%s] fn = %s, write error!\n", __FUNCTION__, path);
+										state_curr = xmodem_state_can_xmt;
 									}
-									pkt_num_l_last = x1p.pkt_num_l;
+									rxw->data_sz[slot] = 0;
+									rx.pkt_num_last++;
+									slot = (uint8_t)(rx.pkt_num_last + 1) % XMODEM_WINDOW_MAX;
 								}
-								else
+								if((uint8_t)(rxw->front - (uint8_t)(rx.pkt_num_last + 1)) > XMODEM_WINDOW_MAX)
 								{
-									xmodem_printf("[%s] duplicate, pkt_num_l = %u (%u)\n", __FUNCTION__, x1p.pkt_num_l, pkt_num_l_last);
+									rxw->front = (uint8_t)(rx.pkt_num_last + 1); //i.e. nothing beyond these was seen
 								}
 							}
+							else if(is_stream == true)
+							{
+								//i.e. no ACK, the transmitter is sending the next frame already
+								state_curr = xmodem_state_wait;
+								deadline = xport_now_us() + xmodem_rtt_idle(&xs->rtt, &to);
+							}
 						}
-					}
-					else
-					{
-						xcp.crc16 |= ch << ((sizeof(xcp.crc16) - crc16_index - 1) * 8);
-						crc16_index++;
-						if(crc16_index >= sizeof(xcp.crc16))
+						break;
+						case xmodem_rx_evt_dup:
 						{
-							uint16_t crc16 = crc_calculate(xcp.data, sizeof(xcp.data));
-							xmodem_printf("[%s] pkt_num_l = %u, pkt_num_h = %u, crc16 = 0x%04x (0x%04x) within %u\n", __FUNCTION__, (unsigned char)xcp.pkt_num_l, (unsigned char)xcp.pkt_num_h, xcp.crc16, crc16, (unsigned int)sizeof(xcp.data));
-							if(crc16 != xcp.crc16)
+							state_prev = state_curr;
+							state_curr = xmodem_state_ack_xmt;
+							if(is_batch == true && rx.buf[1] == 0)
 							{
-								state_curr = xmodem_state_nak_xmt;
+								state_prev = xmodem_state_wait_file; //i.e. block 0 again, its ACK was lost, so ask for the data again
 							}
-							else if((xcp.pkt_num_l + xcp.pkt_num_h) != 0xff)
+							else if(is_stream == true)
 							{
-								state_curr = xmodem_state_can_xmt;
+								state_curr = xmodem_state_can_xmt; //i.e. a streaming transmitter never resends
 							}
-							else
+							else if(rxw != NULL)
 							{
-								state_prev = state_curr;
-								state_curr = xmodem_state_ack_xmt;
-
-								static uint8_t pkt_num_l_last = -1;
-								if(pkt_num_l_last != xcp.pkt_num_l)
+								rsp_num = rx.buf[1];
+							}
+						}
+						break;
+						case xmodem_rx_evt_bad_crc:
+						{
+							state_curr = xmodem_state_nak_xmt;
+							if(rxw != NULL)
+							{
+								//i.e. nothing is purged, and a block whose number is readable is NAKed at once
+								const uint8_t pkt_num = rx.buf[1];
+								const uint8_t off = (uint8_t)(pkt_num - (uint8_t)(rx.pkt_num_last + 1));
+								if((uint8_t)(pkt_num + rx.buf[2]) == 0xff && off < XMODEM_WINDOW_MAX && rxw->data_sz[pkt_num % XMODEM_WINDOW_MAX] == 0)
+								{
+									(void)xmodem_rsp_write(xp, XMODEM_NAK, pkt_num);
+								}
+								state_curr = xmodem_state_wait;
+								deadline = xport_now_us() + xmodem_rtt_idle(&xs->rtt, &to);
+							}
+						}
+						break;
+						case xmodem_rx_evt_bad_seq:
+						{
+							//i.e. a block is missing, so the file can not be completed
+							state_curr = xmodem_state_can_xmt;
+							if(rxw != NULL && is_hdr_due == false)
+							{
+								//i.e. with a window, a block ahead of a missing one is held, and one behind it is a resend whose ACK was lost
+								const uint8_t pkt_num = rx.buf[1];
+								const uint8_t next = (uint8_t)(rx.pkt_num_last + 1);
+								const uint8_t off = (uint8_t)(pkt_num - next);
+								if(off < XMODEM_WINDOW_MAX)
 								{
-									int aret = data_block_append(&dbrcv, &dblast, xcp.data, sizeof(xcp.data));
-									if(aret != 0)
+									const int slot = pkt_num % XMODEM_WINDOW_MAX;
+									if(rxw->data_sz[slot] == 0)
+									{
+										memcpy(rxw->data[slot], &rx.buf[3], rx.len - 5);
+										rxw->data_sz[slot] = rx.len - 5;
+									}
+									//i.e. each block skipped for the first time is NAKed once, so only those are resent
+									if((uint8_t)(rxw->front - next) <= off)
 									{
-										state_curr = xmodem_state_failure;
+										while(rxw->front != pkt_num)
+										{
+											(void)xmodem_rsp_write(xp, XMODEM_NAK, rxw->front);
+											rxw->front++;
+										}
+										rxw->front = (uint8_t)(pkt_num + 1);
 									}
-									pkt_num_l_last = xcp.pkt_num_l;
 								}
-								else
+								if(off < XMODEM_WINDOW_MAX || (uint8_t)(rx.pkt_num_last - pkt_num) < XMODEM_WINDOW_MAX)
 								{
-									xmodem_printf("[%s] duplicate, pkt_num_l = %u (%u)\n", __FUNCTION__, xcp.pkt_num_l, pkt_num_l_last);
+									rsp_num = pkt_num;
+									state_prev = xmodem_state_frame_rcv;
+									state_curr = xmodem_state_ack_xmt;
 								}
 							}
 						}
+						break;
+						case xmodem_rx_evt_more:
+						default:
+						{
+							//i.e. keep receiving
+						}
+						break;
 					}
-					//NOTE: it would be better if such similar code were merged
 				}
 			}
 			break;
 			case xmodem_state_can_xmt:
 			{
-				ch = XMODEM_CAN_HDR;
-				(void)sp_write(hComm, (unsigned char*)&ch, sizeof(ch));
+				//NOTE: with a window, the transmitter needs two in a row, as a single one may be a block number
+				const unsigned char can[2] = {XMODEM_CAN_HDR, XMODEM_CAN_HDR};
+				(void)xport_write(xp, can, (rxw != NULL)?(sizeof(can)):(1));
 				state_prev = state_curr;
 				state_curr = xmodem_state_failure;
 			}
 			break;
 			case xmodem_state_nak_xmt:
 			{
-				ch = XMODEM_NAK;
-				(void)sp_write(hComm, (unsigned char*)&ch, sizeof(ch));
+				//NOTE: a streaming transmitter does not wait for a NAK, only block 0 can be asked for again
+				if(pkt_xfer_retry_count == 0 || (is_stream == true && is_hdr_due == false))
+				{
+					state_curr = xmodem_state_can_xmt;
+					continue;
+				}
+				pkt_xfer_retry_count--;
+				if(rxw != NULL && is_hdr_due == false)
+				{
+					//i.e. with a window, the next block in order is asked for and the frames behind it are kept
+					(void)xmodem_rsp_write(xp, XMODEM_NAK, (uint8_t)(rx.pkt_num_last + 1));
+				}
+				else
+				{
+					xmodem_purge(xp, &to);
+					ch = XMODEM_NAK;
+					(void)xport_write(xp, (unsigned char*)&ch, sizeof(ch));
+				}
+				ts_rsp = xport_now_us();
+				deadline = ts_rsp + xmodem_rtt_idle(&xs->rtt, &to);
 				state_prev = state_curr;
 				state_curr = xmodem_state_wait;
 				
@@ -767,8 +1734,19 @@ int xmodem_receive(const HANDLE hComm, const short ind_time, const char* fnrcv,
 			break;
 			case xmodem_state_ack_xmt:
 			{
-				ch = XMODEM_ACK;
-				(void)sp_write(hComm, (unsigned char*)&ch, sizeof(ch));
+				if(rsp_num >= 0)
+				{
+					(void)xmodem_rsp_write(xp, XMODEM_ACK, (uint8_t)rsp_num);
+					rsp_num = -1;
+				}
+				else
+				{
+					ch = XMODEM_ACK;
+					(void)xport_write(xp, (unsigned char*)&ch, sizeof(ch));
+				}
+				ts_rsp = xport_now_us();
+				deadline = ts_rsp + xmodem_rtt_idle(&xs->rtt, &to);
+				pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
 				switch(state_prev)
 				{
 					case xmodem_state_wait_canc:
@@ -783,7 +1761,14 @@ int xmodem_receive(const HANDLE hComm, const short ind_time, const char* fnrcv,
 						state_curr = xmodem_state_success;
 					}
 					break;
-					case xmodem_state_data_rcv:
+					case xmodem_state_wait_file:
+					{
+						state_prev = state_curr;
+						state_curr = xmodem_state_indicate;
+						ind_deadline = xport_now_us() + ms_to_us(ind_time * 1000);
+					}
+					break;
+					case xmodem_state_frame_rcv:
 					{
 						state_prev = state_curr;
 						state_curr = xmodem_state_wait;
@@ -806,59 +1791,132 @@ int xmodem_receive(const HANDLE hComm, const short ind_time, const char* fnrcv,
 		}
 	}
 
-	if(dbrcv != NULL)
+	if(state_curr == xmodem_state_success && is_batch == false)
 	{
-		if(state_curr == xmodem_state_success)
+		//i.e. an empty file was sent when there is no sink yet
+		if(xmodem_sink_finish(&rs, mtime) != 0)
 		{
-			xmodem_printf("[%s] dbrcv = %p\n", __FUNCTION__, dbrcv);
-			int dret = data_block_store(&dbrcv, fn);
-			xmodem_printf("[%s] dbrcv = %p; dret = %d\n", __FUNCTION__, dbrcv, dret);
+			xmodem_printf(xs->verbose, "[%s] fn = %s, write error!\n", __FUNCTION__, path);
+			state_curr = xmodem_state_failure;
 		}
-		else
+		else if(pad_cnt > 0)
+		{
+			xmodem_printf(xs->verbose, "[%s] warning: fn = %s, pad_cnt = %d\n", __FUNCTION__, path, pad_cnt);
+		}
+		if(is_resume == true && state_curr == xmodem_state_success)
+		{
+			xmodem_ckpt_remove(path);
+		}
+	}
+	else
+	{
+		//NOTE: a failed transfer keeps what was accepted so far, a block held in the decoder is not part of it
+		(void)lz_dec_close(rs.dec);
+		if(rs.snk != NULL && stream_snk_close(rs.snk) == 0 && is_resume == true && ckpt_run.offset > 0)
 		{
-			xmodem_printf("[%s] dbrcv = %p\n", __FUNCTION__, dbrcv);
-			(void)data_block_release(&dbrcv);
-			xmodem_printf("[%s] dbrcv = %p\n", __FUNCTION__, dbrcv);
+			xmodem_printf(xs->verbose, "[%s] fn = %s, checkpoint at offset = %llu\n", __FUNCTION__, path, (unsigned long long)ckpt_run.offset);
+			(void)xmodem_ckpt_save(path, &ckpt_run);
 		}
 	}
-	SYSTEMTIME tsEnd = {0};
-	GetSystemTime(&tsEnd);
+	free(rxw);
+	uint64_t tsEnd = xport_now_us();
+	xmodem_printf(xs->verbose, "[%s] elapsed = %llu us\n", __FUNCTION__, (unsigned long long)(tsEnd - tsBegin));
+	xmodem_printf(xs->verbose, "[%s] rx_calls = %llu, rx_bytes = %llu\n", __FUNCTION__, xp->rx_calls, xp->rx_bytes);
 
-	xmodem_printf("[%s] state_curr = %s\n", __FUNCTION__, xmodem_state_s[state_curr]);
+	xmodem_printf(xs->verbose, "[%s] state_curr = %s\n", __FUNCTION__, xmodem_state_s[state_curr]);
 	return (state_curr == xmodem_state_success)?(0):(-1);
 }
 
-int xmodem_transmit(const HANDLE hComm, const short ind_time, const char* fnxmt, const bool xmodem_1k, xmodem_keep_xfer_cb keep_xfer_cb)
-{
-	const char* fn = (fnxmt == NULL || strlen(fnxmt) == 0)?("default_in.txt"):(fnxmt);
-	struct data_block_t* dbxmt = NULL;
-	xmodem_printf("[%s] hComm = %p (%s)\n", __FUNCTION__, hComm, hComm==INVALID_HANDLE_VALUE?"abnormal":"normal");
-	SYSTEMTIME tsBegin = {0};
-	GetSystemTime(&tsBegin);
-	struct xmodem_crc_pkt_t xcp = {0x0};
-	struct xmodem_1k_pkt_t x1p = {0x0};
-	short ind_retry_count = 0;
-	short pkt_xfer_retry_count = 0;
+int xmodem_receive(struct xmodem_session_t* xs, const char* fnrcv)
+{
+	return xmodem_receive_files(xs, fnrcv, false, NULL, NULL);
+}
+
+int xmodem_receive_batch(struct xmodem_session_t* xs, const char* dir)
+{
+	return xmodem_receive_files(xs, dir, true, NULL, NULL);
+}
+
+int xmodem_receive_stripe(struct xmodem_session_t* xs, const char* dir, struct xmodem_stripe_t* stripe)
+{
+	//i.e. a batch whose segment is reported in stripe, cnt stays 0 when no segment arrived
+	memset(stripe, 0, sizeof(struct xmodem_stripe_t));
+	return xmodem_receive_files(xs, dir, true, stripe, NULL);
+}
+
+int xmodem_receive_sink(struct xmodem_session_t* xs, const struct xmodem_sink_t* snk)
+{
+	return (snk != NULL && snk->write != NULL)?(xmodem_receive_files(xs, "(sink)", false, NULL, snk)):(-1);
+}
+
+static int xmodem_transmit_files(struct xmodem_session_t* xs, const char* const* fns, const int fn_cnt, const bool is_batch, const bool xmodem_1k, const struct xmodem_stripe_t* stripe, const struct xmodem_source_t* in)
+{
+	//i.e. with in, a single file comes from the caller and fns only names it in the log
+	struct xport_t* xp = xs->xp;
+	const short ind_time = xs->ind_time;
+	xmodem_keep_xfer_cb* keep_xfer_cb = xs->keep_xfer_cb;
+	int fn_idx = 0;
+	const char* fn = (fn_cnt > 0)?(fns[0]):(NULL); //i.e. NULL only at the end of a batch
+	if(is_batch == false && (fn == NULL || strlen(fn) == 0))
+	{
+		fn = "default_in.txt";
+	}
+	bool is_hdr_due = is_batch; //i.e. block 0 goes before the data of each file in a batch
+	bool is_hdr_sent = false;   //i.e. the frame on the wire is block 0
+	bool is_stream = false;     //i.e. the receiver asked with 'G', so data frames go back to back
+	uint64_t wire_idle_us = 0;  //i.e. streaming or a window, when the frames written so far have left a link with a baud rate
+	struct xmodem_window_t* win = NULL; //i.e. once the receiver asks with 'W', the frames in flight are kept here
+	const short window = (xs->window == 0)?(XMODEM_WINDOW_DFT):((xs->window > XMODEM_WINDOW_MAX)?(XMODEM_WINDOW_MAX):((short)xs->window));
+	struct xmodem_tx_src_t tx;
+	memset(&tx, 0, sizeof(tx));
+	tx.in = in;
+	tx.verbose = xs->verbose;
+	const bool is_mmap = (xs->flags & XMODEM_FLAG_MMAP)?(true):(false);
+	const bool is_lz = (xs->flags & XMODEM_FLAG_COMPRESS)?(true):(false);
+	struct xmodem_ckpt_t resume = {.offset = 0, .hash = XMODEM_HASH_INIT}; //i.e. the last offer of the receiver, answered again if it is repeated
+	unsigned char resume_rsp = 0x0;
+	xmodem_printf(xs->verbose, "[%s] xp = %p (%s)\n", __FUNCTION__, xp, xp==NULL?"abnormal":xp->ops->name);
+	if(xp != NULL)
+	{
+		xp->tx_timeout_us = ms_to_us(ind_time * 1000); //i.e. a link which stays full for the waiting time has lost its peer
+	}
+	uint64_t tsBegin = xport_now_us();
+	uint64_t ind_deadline = 0;
+	uint64_t deadline = 0;
+	short pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
+	struct xmodem_timeout_t to = {0};
 	bool is_xmodem_1k = xmodem_1k;
-	struct data_block_t* dbiter = NULL;
-	struct data_block_t* dbcurr = NULL;
+	//i.e. XMODEM-1K allows 128-byte frames in between, so it steps down on a noisy link and back up once it is clean
+	const bool is_adaptive = is_xmodem_1k;
+	size_t data_sz = (is_xmodem_1k == true)?(XMODEM_1K_DATA_SZ):(XMODEM_CRC_DATA_SZ);
+	short err_cnt = 0;   //i.e. errors since the last ACK
+	short clean_cnt = 0; //i.e. frames in a row ACKed at the first attempt
+	bool is_nak_only = true; //i.e. every response to the current frame was a NAK, so the receiver has not taken it
+	xmodem_timeout_calc(&to, xs, data_sz + 5);
+	xmodem_rtt_reset(&xs->rtt, &to);
+	uint64_t ts_xmt = 0;
+	bool is_retried = false; //i.e. Karn's algorithm, a response to a resent frame is ambiguous
+	struct xmodem_frame_t frame[2]; //i.e. frame[cur] is on the wire while the other one is encoded
+	int cur = 0;
+	frame[0].is_ready = false;
+	frame[1].is_ready = false;
 	short pkt_num_index = 0;
 	unsigned char ch = 0x0;
 	enum xmodem_state_t state_curr = xmodem_state_initial;
 	enum xmodem_state_t state_prev = xmodem_state_initial;
+	enum xmodem_state_t cached_state_prev = xmodem_state_initial; //i.e. as last printed
+	enum xmodem_state_t cached_state_curr = xmodem_state_initial;
 
 	while(state_curr != xmodem_state_success && state_curr != xmodem_state_failure)
 	{
-		static enum xmodem_state_t cached_state_prev = xmodem_state_initial;
 		if(cached_state_prev != state_prev)
 		{
-			xmodem_printf("[%s] state_prev = %s\n", __FUNCTION__, xmodem_state_s[state_prev]);
+			xmodem_printf(xs->verbose, "[%s] state_prev = %s\n", __FUNCTION__, xmodem_state_s[state_prev]);
 			cached_state_prev = state_prev;
 		}
-		static enum xmodem_state_t cached_state_curr = xmodem_state_initial;
 		if(cached_state_curr != state_curr)
 		{
-			xmodem_printf("[%s] state_curr = %s\n", __FUNCTION__, xmodem_state_s[state_curr]);
+			xmodem_printf(xs->verbose, "[%s] state_curr = %s\n", __FUNCTION__, xmodem_state_s[state_curr]);
 			cached_state_curr = state_curr;
 		}
 
@@ -866,12 +1924,12 @@ int xmodem_transmit(const HANDLE hComm, const short ind_time, const char* fnxmt,
 		{
 			case xmodem_state_initial:
 			{
-				int cret = data_block_load(&dbxmt, fn, is_xmodem_1k==true?sizeof(x1p.data):sizeof(xcp.data));
-				if(cret == 0)
+				if(xmodem_tx_open(&tx, fn, is_mmap, is_lz, stripe) == 0)
 				{
 					state_prev = state_curr;
 					state_curr = xmodem_state_wait;
-					ind_retry_count = ind_time*XMODEM_INDICATE_MULTIPLICATION;
+					ind_deadline = xport_now_us() + ms_to_us(ind_time * 1000);
+					deadline = ind_deadline;
 				}
 				else
 				{
@@ -886,8 +1944,8 @@ int xmodem_transmit(const HANDLE hComm, const short ind_time, const char* fnxmt,
 					state_curr = xmodem_state_can_xmt;
 					continue;
 				}
-				int rret = sp_read(hComm, &ch, sizeof(ch));
-				//xmodem_printf("[%s] rret = %d, ch = 0x%02x\n", __FUNCTION__, rret, (unsigned char)ch);
+				int rret = xmodem_read_until(xp, &ch, sizeof(ch), deadline);
+				//xmodem_printf(xs->verbose, "[%s] rret = %d, ch = 0x%02x\n", __FUNCTION__, rret, (unsigned char)ch);
 				if(rret < 0)
 				{
 					state_curr = xmodem_state_failure;
@@ -898,82 +1956,204 @@ int xmodem_transmit(const HANDLE hComm, const short ind_time, const char* fnxmt,
 					{
 						case xmodem_state_initial:
 						{
-							if(ind_retry_count == 0)
+							if(xport_now_us() >= ind_deadline)
 							{
 								state_curr = xmodem_state_failure;
 							}
-							else
-							{
-								ind_retry_count--;
-								msleep(XMODEM_INDICATE_TIMEOUT);
-							}
 						}
 						break;
 						case xmodem_state_data_xmt:
+						case xmodem_state_eot_xmt:
 						{
-							if(pkt_xfer_retry_count == 0)
-							{
-								state_curr = xmodem_state_failure;
-							}
-							else
+							if(xport_now_us() >= deadline)
 							{
-								pkt_xfer_retry_count--;
-								msleep(XMODEM_PKT_XFER_TIMEOUT);
+								if(pkt_xfer_retry_count == 0)
+								{
+									state_curr = xmodem_state_can_xmt;
+								}
+								else
+								{
+									//i.e. the frame or its response is lost, so resend it
+									if(state_prev == xmodem_state_data_xmt)
+									{
+										is_nak_only = false;
+										err_cnt++;
+										clean_cnt = 0;
+										if(is_adaptive == true && is_hdr_sent == false && data_sz == XMODEM_1K_DATA_SZ && err_cnt >= XMODEM_BLK_DOWN_ERRS)
+										{
+											xmodem_printf(xs->verbose, "[%s] step down, pkt_num = %u, is_nak_only = %d\n", __FUNCTION__, (unsigned int)pkt_num_index, is_nak_only);
+											data_sz = XMODEM_CRC_DATA_SZ;
+											(void)xmodem_tx_step_down(&tx, &frame[cur], &frame[cur ^ 1], is_nak_only);
+											pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT; //i.e. whether it was cut again or not, the frame starts over
+										}
+									}
+									pkt_xfer_retry_count--;
+									xmodem_rtt_backoff(&xs->rtt);
+									is_retried = true;
+									state_curr = state_prev;
+								}
 							}
 						}
 						break;
 						default:
 						{
-							//do nothing
+							//i.e. keep waiting
+							if(xport_now_us() >= deadline)
+							{
+								deadline = xport_now_us() + xs->rtt.rto_us;
+							}
 						}
 						break;
 					}
 				}
 				else
 				{
+					if((ch == XMODEM_ACK || ch == XMODEM_NAK) && (state_prev == xmodem_state_data_xmt || state_prev == xmodem_state_eot_xmt) && is_retried == false)
+					{
+						xmodem_rtt_sample(&xs->rtt, xport_now_us() - ts_xmt);
+						xmodem_printf(xs->verbose, "[%s] srtt = %llu us, rttvar = %llu us, rto = %llu us\n", __FUNCTION__, (unsigned long long)xs->rtt.srtt_us, (unsigned long long)xs->rtt.rttvar_us, (unsigned long long)xs->rtt.rto_us);
+					}
+					if((ch == XMODEM_CRC_IND || ch == XMODEM_G_IND || ch == XMODEM_W_IND) && state_prev == xmodem_state_eot_xmt && is_batch == true)
+					{
+						ch = XMODEM_ACK; //i.e. the receiver asks for the next file already, so the ACK of the EOT was lost
+					}
 					switch(ch)
 					{
 						case XMODEM_CRC_IND:
+						case XMODEM_G_IND:
+						case XMODEM_W_IND:
 						{
 							switch(state_prev)
 							{
 								case xmodem_state_data_xmt:
 								{
+									is_nak_only = false;
 									state_curr = xmodem_state_data_xmt;
 								}
 								break;
 								case xmodem_state_initial:
 								default:
 								{
-									state_curr = xmodem_state_data_xmt;
-									data_block_iterate(&dbxmt, &dbiter, &dbcurr);
-									pkt_num_index = 1;
+									is_stream = (ch == XMODEM_G_IND)?(true):(false);
+									state_curr = (is_hdr_due == true)?(xmodem_state_hdr_load):(xmodem_state_data_load);
+									pkt_num_index = (is_hdr_due == true)?(0):(1);
+									if(ch == XMODEM_W_IND && is_hdr_due == false)
+									{
+										win = (win == NULL)?((struct xmodem_window_t*)calloc(1, sizeof(struct xmodem_window_t))):(win);
+										if(win == NULL)
+										{
+											state_curr = xmodem_state_can_xmt;
+											break;
+										}
+										xmodem_window_reset(win, 1);
+										xmodem_tx_carry(&tx, &frame[cur ^ 1]); //i.e. block 1 may be encoded already, behind block 0 of a batch
+										state_curr = xmodem_state_window_xmt;
+									}
 								}
 								break;
 							}
 						}
 						break;
+						case XMODEM_R_IND:
+						{
+							//i.e. before the first frame of a single file, the source is moved to where the copy of the receiver ends
+							uint8_t offer[XMODEM_RESUME_OFFER_SZ] = {XMODEM_R_IND};
+							struct xmodem_ckpt_t got = {.offset = 0, .hash = 0};
+							if(state_prev != xmodem_state_initial || is_batch == true)
+							{
+								break;
+							}
+							if(xmodem_read_full(xp, &offer[1], sizeof(offer) - 1, xport_now_us() + to.ack_us) != (int)(sizeof(offer) - 1) || xmodem_resume_parse(offer, &got) != 0)
+							{
+								break; //i.e. noise, or a damaged offer which the receiver repeats
+							}
+							if(resume_rsp == 0x0 || got.offset != resume.offset || got.hash != resume.hash)
+							{
+								uint64_t hash = XMODEM_HASH_INIT;
+								xmodem_tx_close(&tx);
+								if(xmodem_tx_open(&tx, fn, is_mmap, is_lz, NULL) != 0)
+								{
+									state_curr = xmodem_state_can_xmt;
+									break;
+								}
+								resume = got;
+								resume_rsp = XMODEM_ACK;
+								if(xmodem_tx_skip(&tx, got.offset, &hash) != 0 || hash != got.hash)
+								{
+									//i.e. the file of the receiver is not a prefix of ours, so it is sent from the start
+									xmodem_tx_close(&tx);
+									resume_rsp = (xmodem_tx_open(&tx, fn, is_mmap, is_lz, NULL) == 0)?(XMODEM_NAK):(XMODEM_CAN_HDR);
+								}
+								xmodem_printf(xs->verbose, "[%s] fn = %s, resume offset = %llu, %s\n", __FUNCTION__, fn, (unsigned long long)got.offset, (resume_rsp == XMODEM_ACK)?("taken"):("refused"));
+							}
+							(void)xport_write(xp, &resume_rsp, sizeof(resume_rsp));
+							state_curr = (resume_rsp == XMODEM_CAN_HDR)?(xmodem_state_failure):(state_curr);
+						}
+						break;
 						case XMODEM_ACK:
 						{
 							switch(state_prev)
 							{
 								case xmodem_state_data_xmt:
 								{
-									pkt_num_index++;
-									if(!data_block_has_next(&dbxmt, &dbiter))
+									if(is_retried == true)
+									{
+										//i.e. a resent frame may be answered twice, and the late ACK must not be taken for the next frame
+										xmodem_purge(xp, &to);
+									}
+									if(is_hdr_sent == true)
 									{
-										state_curr = xmodem_state_eot_xmt;
+										//i.e. the receiver asks for the data with another indication, unless the batch is over
+										is_hdr_sent = false;
+										is_hdr_due = false;
+										pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
+										is_retried = false;
+										state_prev = xmodem_state_initial;
+										state_curr = (fn == NULL)?(xmodem_state_success):(xmodem_state_wait);
+										ind_deadline = xport_now_us() + ms_to_us(ind_time * 1000);
+										deadline = ind_deadline;
+										break;
 									}
-									else
+									pkt_num_index = (pkt_num_index + 1) & 0xff; //i.e. block numbers wrap from 255 to 0
+									clean_cnt = (is_retried == true)?(0):(clean_cnt + 1);
+									err_cnt = 0;
+									if(is_adaptive == true && data_sz == XMODEM_CRC_DATA_SZ && clean_cnt >= XMODEM_BLK_UP_RUN && tx.carry_len == 0)
 									{
-										state_curr = xmodem_state_data_xmt;
-										data_block_iterate(&dbxmt, &dbiter, &dbcurr);
+										//NOTE: it applies from the frame after the one encoded already
+										xmodem_printf(xs->verbose, "[%s] step up, pkt_num = %u\n", __FUNCTION__, (unsigned int)pkt_num_index);
+										data_sz = XMODEM_1K_DATA_SZ;
+										clean_cnt = 0;
 									}
+									pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
+									is_retried = false;
+									state_curr = xmodem_state_data_load;
 								}
 								break;
 								case xmodem_state_eot_xmt:
 								{
-									state_curr = xmodem_state_success;
+									if(is_batch == false)
+									{
+										state_curr = xmodem_state_success;
+										break;
+									}
+									//i.e. on to block 0 of the next file, or the empty one which ends the batch
+									xmodem_tx_close(&tx);
+									fn_idx += (fn_idx < fn_cnt)?(1):(0);
+									fn = (fn_idx < fn_cnt)?(fns[fn_idx]):(NULL);
+									if(xmodem_tx_open(&tx, fn, is_mmap, is_lz, stripe) != 0)
+									{
+										state_curr = xmodem_state_can_xmt;
+										break;
+									}
+									frame[0].is_ready = false;
+									frame[1].is_ready = false;
+									is_hdr_due = true;
+									pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
+									is_retried = false;
+									state_prev = xmodem_state_initial;
+									state_curr = xmodem_state_wait;
+									ind_deadline = xport_now_us() + ms_to_us(ind_time * 1000);
+									deadline = ind_deadline;
 								}
 								break;
 								default:
@@ -986,7 +2166,28 @@ int xmodem_transmit(const HANDLE hComm, const short ind_time, const char* fnxmt,
 						break;
 						case XMODEM_NAK:
 						{
-							state_curr = xmodem_state_data_xmt;
+							if(pkt_xfer_retry_count == 0)
+							{
+								state_curr = xmodem_state_can_xmt;
+							}
+							else
+							{
+								pkt_xfer_retry_count--;
+								is_retried = true;
+								state_curr = (state_prev == xmodem_state_eot_xmt)?(xmodem_state_eot_xmt):(xmodem_state_data_xmt);
+								if(state_prev == xmodem_state_data_xmt)
+								{
+									err_cnt++;
+									clean_cnt = 0;
+									if(is_adaptive == true && is_hdr_sent == false && data_sz == XMODEM_1K_DATA_SZ && err_cnt >= XMODEM_BLK_DOWN_ERRS)
+									{
+										xmodem_printf(xs->verbose, "[%s] step down, pkt_num = %u, is_nak_only = %d\n", __FUNCTION__, (unsigned int)pkt_num_index, is_nak_only);
+										data_sz = XMODEM_CRC_DATA_SZ;
+										(void)xmodem_tx_step_down(&tx, &frame[cur], &frame[cur ^ 1], is_nak_only);
+										pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT; //i.e. whether it was cut again or not, the frame starts over
+									}
+								}
+							}
 						}
 						break;
 						case XMODEM_CAN_HDR:
@@ -1003,102 +2204,245 @@ int xmodem_transmit(const HANDLE hComm, const short ind_time, const char* fnxmt,
 				}
 			}
 			break;
+			case xmodem_state_hdr_load:
+			{
+				//i.e. block 0 goes out as an ordinary frame, so resends and time-outs work the same
+				struct xmodem_frame_t* hdr = &frame[cur];
+				hdr->blk = &hdr->buf[3];
+				hdr->len = (int)xmodem_hdr_build(&hdr->buf[3], XMODEM_1K_DATA_SZ, fn, stripe);
+				xmodem_frame_seal(hdr, hdr->len, 0);
+				frame[cur ^ 1].is_ready = false;
+				xmodem_printf(xs->verbose, "[%s] fn = %s, block 0 within %d\n", __FUNCTION__, (fn == NULL)?("(end)"):(fn), hdr->len);
+				is_hdr_sent = true;
+				state_curr = xmodem_state_data_xmt;
+			}
+			break;
+			case xmodem_state_data_load:
+			{
+				//i.e. the next frame is normally encoded already, while the previous one was on the wire
+				struct xmodem_frame_t* next = &frame[cur ^ 1];
+				if(next->is_ready == false)
+				{
+					xmodem_frame_encode(next, &tx, data_sz, (uint8_t)pkt_num_index);
+				}
+				frame[cur].is_ready = false;
+				cur ^= 1;
+				is_nak_only = true;
+				if(frame[cur].len < 0)
+				{
+					xmodem_printf(xs->verbose, "[%s] fn = %s, read error!\n", __FUNCTION__, fn);
+					state_curr = xmodem_state_can_xmt;
+				}
+				else if(frame[cur].len == 0)
+				{
+					state_curr = xmodem_state_eot_xmt;
+				}
+				else
+				{
+					state_curr = xmodem_state_data_xmt;
+				}
+			}
+			break;
 			case xmodem_state_data_xmt:
 			{
-				if(!data_block_is_empty(dbcurr))
+				const uint8_t* buf = frame[cur].buf;
+				const size_t DATA_SZ = frame[cur].data_sz;
+				xmodem_printf(xs->verbose, "[%s] pkt_num_l = %u, pkt_num_h = %u, crc16 = 0x%02x%02x within %u\n", __FUNCTION__, buf[1], buf[2], buf[3 + DATA_SZ], buf[4 + DATA_SZ], (unsigned int)DATA_SZ);
+				ts_xmt = xport_now_us();
+				int wret = xmodem_frame_write(xp, &frame[cur]);
+				//NOTE: transmission rate will be slowed down with following manner
+				//int wret = 0;
+				//int k = 0;
+				//for(k = 0; k < DATA_SZ + 5; k++)
+				//{
+				//	(void)xport_write(xp, &buf[k], sizeof(buf[k]));
+				//	msleep(1);
+				//}
+				//wret = k;
+
+				//xmodem_printf(xs->verbose, "[%s] wret = %d\n", __FUNCTION__, wret);
+				if(wret == (int)(DATA_SZ + 5))
 				{
-					if(is_xmodem_1k == true)
+					//i.e. frame N+1 is built while frame N and its response are in flight, a resend finds it ready
+					if(frame[cur ^ 1].is_ready == false)
 					{
-						x1p.hdr = XMODEM_1K_HDR;
-						if(pkt_num_index > 255)
-						{
-							pkt_num_index = 0;
-						}
-						x1p.pkt_num_l = (uint8_t)pkt_num_index;
-						x1p.pkt_num_h = (uint8_t)(255 - pkt_num_index);
-						data_block_copy(x1p.data, dbcurr);
-						uint16_t crc16 = crc_calculate(x1p.data, sizeof(x1p.data));
-						x1p.crc16 = 0x0;
-						x1p.crc16 |= (crc16 >> 8) & 0x00ff;
-						x1p.crc16 |= (crc16 << 8) & 0xff00;
-						xmodem_printf("[%s] pkt_num_l = %u, pkt_num_h = %u, crc16 = 0x%04x (0x%04x) within %u\n", __FUNCTION__, (unsigned char)x1p.pkt_num_l, (unsigned char)x1p.pkt_num_h, x1p.crc16, crc16, (unsigned int)sizeof(x1p.data));
-						int wret = sp_write(hComm, (unsigned char*)&x1p, sizeof(x1p));
-						//NOTE: transmission rate will be slowed down with following manner
-						//int wret = 0;
-						//int k = 0;
-						//unsigned char* p = (unsigned char*)&x1p;
-						//for(k = 0; k < sizeof(x1p); k++)
-						//{
-						//	(void)sp_write(hComm, p, sizeof(*p));
-						//	p++;
-						//	msleep(1);
-						//}
-						//wret = k;
-
-						//xmodem_printf("[%s] wret = %d\n", __FUNCTION__, wret);
-						if(wret == sizeof(x1p))
-						{
-							state_prev = state_curr;
-							state_curr = xmodem_state_wait;
-							pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
-						}
+						xmodem_frame_encode(&frame[cur ^ 1], &tx, data_sz, (uint8_t)(pkt_num_index + 1));
 					}
-					else
+					state_prev = state_curr;
+					if(is_stream == true && is_hdr_sent == false)
 					{
-						xcp.hdr = XMODEM_CRC_HDR;
-						if(pkt_num_index > 255)
+						//i.e. streaming, the frame counts as taken unless the receiver cancels, which is checked without waiting
+						int rret = xport_read(xp, &ch, sizeof(ch));
+						if(rret < 0 || (rret > 0 && ch == XMODEM_CAN_HDR))
 						{
-							pkt_num_index = 0;
+							state_curr = xmodem_state_failure;
 						}
-						xcp.pkt_num_l = (uint8_t)pkt_num_index;
-						xcp.pkt_num_h = (uint8_t)(255 - pkt_num_index);
-						data_block_copy(xcp.data, dbcurr);
-						uint16_t crc16 = crc_calculate(xcp.data, sizeof(xcp.data));
-						xcp.crc16 = 0x0;
-						xcp.crc16 |= (crc16 >> 8) & 0x00ff;
-						xcp.crc16 |= (crc16 << 8) & 0xff00;
-						xmodem_printf("[%s] pkt_num_l = %u, pkt_num_h = %u, crc16 = 0x%04x (0x%04x) within %u\n", __FUNCTION__, (unsigned char)xcp.pkt_num_l, (unsigned char)xcp.pkt_num_h, xcp.crc16, crc16, (unsigned int)sizeof(xcp.data));
-						int wret = sp_write(hComm, (unsigned char*)&xcp, sizeof(xcp));
-						//NOTE: transmission rate will be slowed down with following manner
-						//int wret = 0;
-						//int k = 0;
-						//unsigned char* p = (unsigned char*)&xcp;
-						//for(k = 0; k < sizeof(xcp); k++)
-						//{
-						//	(void)sp_write(hComm, p, sizeof(*p));
-						//	p++;
-						//	msleep(1);
-						//}
-						//wret = k;
-
-						//xmodem_printf("[%s] wret = %d\n", __FUNCTION__, wret);
-						if(wret == sizeof(xcp))
+						else if(keep_xfer_cb != NULL && !keep_xfer_cb())
 						{
-							state_prev = state_curr;
-							state_curr = xmodem_state_wait;
-							pkt_xfer_retry_count = XMODEM_PKT_XFER_RETRY_COUNT;
+							state_curr = xmodem_state_can_xmt;
 						}
 						else
 						{
-							xmodem_printf("[%s] unexpected behavior!\n", __FUNCTION__);
-							state_prev = state_curr;
-							state_curr = xmodem_state_failure;
+							wire_idle_us = ((wire_idle_us > ts_xmt)?(wire_idle_us):(ts_xmt)) + to.frame_us;
+							pkt_num_index = (pkt_num_index + 1) & 0xff;
+							state_curr = xmodem_state_data_load;
 						}
 					}
-					//NOTE: it would be better if such similar code were merged
+					else
+					{
+						state_curr = xmodem_state_wait;
+						deadline = ts_xmt + xs->rtt.rto_us;
+					}
 				}
 				else
 				{
-					xmodem_printf("[%s] unexpected behavior!\n", __FUNCTION__);
+					xmodem_printf(xs->verbose, "[%s] unexpected behavior!\n", __FUNCTION__);
 					state_prev = state_curr;
 					state_curr = xmodem_state_failure;
 				}
 			}
 			break;
+			case xmodem_state_window_xmt:
+			{
+				//i.e. up to window frames are in flight, each stays encoded until its own ACK, and only a NAKed or overdue one is resent
+				if(keep_xfer_cb != NULL && !keep_xfer_cb())
+				{
+					state_curr = xmodem_state_can_xmt;
+					continue;
+				}
+				while(win->cnt < window && win->is_eof == false && state_curr == xmodem_state_window_xmt)
+				{
+					const uint8_t pkt_num = (uint8_t)(win->base + win->cnt);
+					const int slot = pkt_num % XMODEM_WINDOW_MAX;
+					xmodem_frame_encode(&win->frame[slot], &tx, data_sz, pkt_num);
+					if(win->frame[slot].len < 0)
+					{
+						xmodem_printf(xs->verbose, "[%s] fn = %s, read error!\n", __FUNCTION__, fn);
+						state_curr = xmodem_state_can_xmt;
+					}
+					else if(win->frame[slot].len == 0)
+					{
+						win->is_eof = true;
+					}
+					else
+					{
+						win->retry[slot] = XMODEM_PKT_XFER_RETRY_COUNT;
+						win->is_acked[slot] = false;
+						win->is_retried[slot] = false;
+						state_curr = (xmodem_window_send(xp, win, pkt_num, &to, &wire_idle_us) == 0)?(state_curr):(xmodem_state_failure);
+						win->cnt++;
+					}
+				}
+				if(state_curr != xmodem_state_window_xmt)
+				{
+					break;
+				}
+				if(win->cnt == 0)
+				{
+					//i.e. every block is ACKed, and a late response to a resent frame must not be taken for the ACK of the EOT
+					if(win->is_resent == true)
+					{
+						xmodem_purge(xp, &to);
+					}
+					state_curr = xmodem_state_eot_xmt;
+					break;
+				}
+				const int base_slot = win->base % XMODEM_WINDOW_MAX;
+				deadline = win->ts[base_slot] + xs->rtt.rto_us;
+				unsigned char rsp[16] = {0x0};
+				int rret = xmodem_read_until(xp, rsp, sizeof(rsp), deadline);
+				if(rret < 0)
+				{
+					state_curr = xmodem_state_failure;
+				}
+				else if(rret == 0 && xport_now_us() >= deadline)
+				{
+					//i.e. the oldest frame or its response is lost
+					if(win->retry[base_slot] == 0)
+					{
+						state_curr = xmodem_state_can_xmt;
+						break;
+					}
+					win->retry[base_slot]--;
+					win->is_retried[base_slot] = true;
+					win->is_resent = true;
+					err_cnt++;
+					clean_cnt = 0;
+					xmodem_rtt_backoff(&xs->rtt);
+					state_curr = (xmodem_window_send(xp, win, win->base, &to, &wire_idle_us) == 0)?(state_curr):(xmodem_state_failure);
+				}
+				int k = 0;
+				for(k = 0; k < rret && state_curr == xmodem_state_window_xmt; k++)
+				{
+					uint8_t pkt_num = 0;
+					const unsigned char rsp_ch = xmodem_window_rsp(win, rsp[k], &pkt_num);
+					const uint8_t off = (uint8_t)(pkt_num - win->base);
+					const int slot = pkt_num % XMODEM_WINDOW_MAX;
+					if(rsp_ch == XMODEM_CAN_HDR)
+					{
+						state_curr = xmodem_state_failure;
+					}
+					else if(rsp_ch == 0 || off >= win->cnt || win->is_acked[slot] == true)
+					{
+						//i.e. incomplete, or it answers a block which is done already
+					}
+					else if(rsp_ch == XMODEM_ACK)
+					{
+						win->is_acked[slot] = true;
+						const uint64_t now = xport_now_us();
+						if(win->is_retried[slot] == false && now > win->ts[slot])
+						{
+							//NOTE: the time on the wire is rounded up per byte, so a frame may be answered before it was expected to be sent
+							xmodem_rtt_sample(&xs->rtt, now - win->ts[slot]);
+						}
+						clean_cnt = (win->is_retried[slot] == true)?(0):(clean_cnt + 1);
+						err_cnt = (win->is_retried[slot] == true)?(err_cnt):(0);
+					}
+					else if(win->is_retried[slot] == true && xport_now_us() < win->ts[slot] + ((xs->rtt.samples > 0)?(xs->rtt.srtt_us):(xs->rtt.rto_us)))
+					{
+						//i.e. the receiver NAKs a gap more than once (ahead frame, damaged frame), the resend is not due to be answered yet
+						//NOTE: not the RTO, which may be backed off far beyond the round trip
+					}
+					else if(win->retry[slot] == 0)
+					{
+						state_curr = xmodem_state_can_xmt;
+					}
+					else
+					{
+						win->retry[slot]--;
+						win->is_retried[slot] = true;
+						win->is_resent = true;
+						err_cnt++;
+						clean_cnt = 0;
+						state_curr = (xmodem_window_send(xp, win, pkt_num, &to, &wire_idle_us) == 0)?(state_curr):(xmodem_state_failure);
+					}
+				}
+				//NOTE: frames in flight keep their size, so only the blocks not encoded yet step between 1K and 128 bytes
+				if(is_adaptive == true && data_sz == XMODEM_1K_DATA_SZ && err_cnt >= XMODEM_BLK_DOWN_ERRS)
+				{
+					xmodem_printf(xs->verbose, "[%s] step down, pkt_num = %u\n", __FUNCTION__, (unsigned int)(uint8_t)(win->base + win->cnt));
+					data_sz = XMODEM_CRC_DATA_SZ;
+					err_cnt = 0;
+				}
+				else if(is_adaptive == true && data_sz == XMODEM_CRC_DATA_SZ && clean_cnt >= XMODEM_BLK_UP_RUN && tx.carry_len == 0)
+				{
+					xmodem_printf(xs->verbose, "[%s] step up, pkt_num = %u\n", __FUNCTION__, (unsigned int)(uint8_t)(win->base + win->cnt));
+					data_sz = XMODEM_1K_DATA_SZ;
+					clean_cnt = 0;
+				}
+				//i.e. the window slides over the blocks ACKed in order
+				while(win->cnt > 0 && win->is_acked[win->base % XMODEM_WINDOW_MAX] == true)
+				{
+					win->is_acked[win->base % XMODEM_WINDOW_MAX] = false;
+					win->base++;
+					win->cnt--;
+				}
+			}
+			break;
 			case xmodem_state_can_xmt:
 			{
 				ch = XMODEM_CAN_HDR;
-				(void)sp_write(hComm, (unsigned char*)&ch, sizeof(ch));
+				(void)xport_write(xp, (unsigned char*)&ch, sizeof(ch));
 				state_prev = state_curr;
 				state_curr = xmodem_state_failure;
 			}
@@ -1106,7 +2450,13 @@ int xmodem_transmit(const HANDLE hComm, const short ind_time, const char* fnxmt,
 			case xmodem_state_eot_xmt:
 			{
 				ch = XMODEM_EOT_HDR;
-				(void)sp_write(hComm, (unsigned char*)&ch, sizeof(ch));
+				ts_xmt = xport_now_us();
+				(void)xport_write(xp, (unsigned char*)&ch, sizeof(ch));
+				deadline = ts_xmt + xs->rtt.rto_us;
+				if(wire_idle_us > ts_xmt)
+				{
+					deadline += wire_idle_us - ts_xmt; //i.e. streaming, the EOT queues behind frames still on the wire
+				}
 				state_prev = state_curr;
 				state_curr = xmodem_state_wait;
 			}
@@ -1119,15 +2469,36 @@ int xmodem_transmit(const HANDLE hComm, const short ind_time, const char* fnxmt,
 			break;
 		}
 	}
-	if(dbxmt != NULL)
-	{
-		xmodem_printf("[%s] dbxmt = %p\n", __FUNCTION__, dbxmt);
-		(void)data_block_release(&dbxmt);
-		xmodem_printf("[%s] dbxmt = %p\n", __FUNCTION__, dbxmt);
-	}
-	SYSTEMTIME tsEnd = {0};
-	GetSystemTime(&tsEnd);
+	xmodem_tx_close(&tx);
+	free(win);
+	uint64_t tsEnd = xport_now_us();
+	xmodem_printf(xs->verbose, "[%s] elapsed = %llu us\n", __FUNCTION__, (unsigned long long)(tsEnd - tsBegin));
 
-	xmodem_printf("[%s] state_curr = %s\n", __FUNCTION__, xmodem_state_s[state_curr]);
+	xmodem_printf(xs->verbose, "[%s] state_curr = %s\n", __FUNCTION__, xmodem_state_s[state_curr]);
 	return (state_curr == xmodem_state_success)?(0):(-1);
 }
+
+int xmodem_transmit(struct xmodem_session_t* xs, const char* fnxmt, const bool xmodem_1k)
+{
+	return xmodem_transmit_files(xs, &fnxmt, 1, false, xmodem_1k, NULL, NULL);
+}
+
+int xmodem_transmit_batch(struct xmodem_session_t* xs, const char* const* fns, const int cnt, const bool xmodem_1k)
+{
+	return xmodem_transmit_files(xs, fns, cnt, true, xmodem_1k, NULL, NULL);
+}
+
+int xmodem_transmit_stripe(struct xmodem_session_t* xs, const char* fn, const struct xmodem_stripe_t* stripe, const bool xmodem_1k)
+{
+	return xmodem_transmit_files(xs, &fn, 1, true, xmodem_1k, stripe, NULL);
+}
+
+int xmodem_transmit_source(struct xmodem_session_t* xs, const struct xmodem_source_t* src, const bool xmodem_1k)
+{
+	const char* fn = "(source)";
+	if(src == NULL || (src->data == NULL && src->read == NULL && src->size > 0))
+	{
+		return -1;
+	}
+	return xmodem_transmit_files(xs, &fn, 1, false, xmodem_1k, NULL, src);
+}
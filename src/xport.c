@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "xport.h"
+#include "loop.h"
+#include "sock.h"
+#ifdef _WIN32
+#include "sp.h"
+#else
+#include "tty.h"
+#endif
+
+static const struct xport_ops_t* xport_backends[] =
+{
+#ifdef _WIN32
+	&sp_xport_ops,
+#else
+	&tty_xport_ops,
+	&tty_pty_xport_ops,
+#endif
+	&loop_xport_ops,
+	&sock_tcp_xport_ops,
+	&sock_tcp_listen_xport_ops,
+#ifndef _WIN32
+	&sock_unix_xport_ops,
+	&sock_unix_listen_xport_ops,
+#endif
+};
+
+bool xport_name_is(const char* name, const char* prefix)
+{
+	//i.e. the prefix is a whole word, so a native device such as ptyp0 or loopback0 is not taken for a backend
+	const size_t len = strlen(prefix);
+	return (strncmp(name, prefix, len) == 0 && (name[len] == ':' || name[len] == '\0'))?(true):(false);
+}
+
+static const struct xport_ops_t* xport_backend_find(const char* name)
+{
+	const struct xport_ops_t* native = NULL;
+	size_t k = 0;
+	for(k = 0; k < sizeof(xport_backends)/sizeof(xport_backends[0]); k++)
+	{
+		const struct xport_ops_t* ops = xport_backends[k];
+		if(ops->prefix == NULL)
+		{
+			native = ops;
+		}
+		else if(xport_name_is(name, ops->prefix) == true)
+		{
+			return ops;
+		}
+	}
+	return native;
+}
+
+int xport_query(char*** name_list, int* cnt, const bool verbose)
+{
+	int ret = -1;
+	do
+	{
+		if(name_list == NULL || cnt == NULL)
+		{
+			break;
+		}
+		*name_list = NULL;
+		*cnt = 0;
+#ifdef _WIN32
+		int* port_number_list = NULL;
+		int port_cnt = 0;
+		if(sp_query(&port_number_list, &port_cnt, (verbose == true)?(TRUE):(FALSE)) != 0)
+		{
+			break;
+		}
+		char** list = NULL;
+		if(port_cnt > 0)
+		{
+			list = (char**)calloc(port_cnt, sizeof(char*));
+		}
+		int k = 0;
+		for(k = 0; list != NULL && k < port_cnt; k++)
+		{
+			char buf[16] = {'\0'};
+			snprintf(buf, sizeof(buf), "COM%d", port_number_list[k]);
+			list[k] = strdup(buf);
+		}
+		free(port_number_list);
+		*name_list = list;
+		*cnt = (list != NULL)?(port_cnt):(0);
+		ret = 0;
+#else
+		ret = tty_query(name_list, cnt, verbose);
+#endif
+	} while(0);
+	return ret;
+}
+
+void xport_query_release(char** name_list, int cnt)
+{
+	int k = 0;
+	if(name_list == NULL)
+	{
+		return;
+	}
+	for(k = 0; k < cnt; k++)
+	{
+		free(name_list[k]);
+	}
+	free(name_list);
+}
+
+struct xport_t* xport_open(const char* name, unsigned long baud, const bool verbose, const uint64_t open_timeout_us, xport_keep_cb* keep_cb)
+{
+	struct xport_t* xp = NULL;
+	do
+	{
+		if(name == NULL)
+		{
+			break;
+		}
+		const struct xport_ops_t* ops = xport_backend_find(name);
+		if(ops == NULL)
+		{
+			break;
+		}
+		xp = (struct xport_t*)calloc(1, sizeof(struct xport_t));
+		if(xp == NULL)
+		{
+			break;
+		}
+		xp->ops = ops;
+		xp->baud = baud;
+		xp->verbose = verbose;
+		xp->open_timeout_us = open_timeout_us;
+		xp->keep_cb = keep_cb;
+		xp->tx_timeout_us = (uint64_t)XPORT_TX_TIMEOUT * 1000ULL;
+		xp->rx_buf = (unsigned char*)malloc(XPORT_RX_BUF_SZ);
+		if(xp->rx_buf == NULL)
+		{
+			free(xp);
+			xp = NULL;
+			break;
+		}
+		if(ops->open(xp, name, baud) != 0)
+		{
+			free(xp->rx_buf);
+			free(xp);
+			xp = NULL;
+			break;
+		}
+	} while(0);
+	return xp;
+}
+
+void xport_close(struct xport_t* xp)
+{
+	if(xp == NULL)
+	{
+		return;
+	}
+	xp->ops->close(xp);
+	free(xp->rx_buf);
+	free(xp);
+}
+
+int xport_read(struct xport_t* xp, unsigned char* buf, const size_t BUF_SZ)
+{
+	//i.e. drain whatever the driver has in one call, then serve callers from rx_buf
+	if(xp->rx_head == xp->rx_tail)
+	{
+		xp->rx_head = 0;
+		xp->rx_tail = 0;
+		if(BUF_SZ >= XPORT_RX_BUF_SZ)
+		{
+			int rret = xp->ops->read(xp, buf, BUF_SZ);
+			xp->rx_calls++;
+			xp->rx_bytes += (rret > 0)?(rret):(0);
+			return rret;
+		}
+		int rret = xp->ops->read(xp, xp->rx_buf, XPORT_RX_BUF_SZ);
+		xp->rx_calls++;
+		if(rret <= 0)
+		{
+			return rret;
+		}
+		xp->rx_bytes += rret;
+		xp->rx_tail = (size_t)rret;
+	}
+	size_t cnt = xp->rx_tail - xp->rx_head;
+	if(cnt > BUF_SZ)
+	{
+		cnt = BUF_SZ;
+	}
+	memcpy(buf, &xp->rx_buf[xp->rx_head], cnt);
+	xp->rx_head += cnt;
+	return (int)cnt;
+}
+
+int xport_write(struct xport_t* xp, const unsigned char* buf, const size_t BUF_SZ)
+{
+	return xp->ops->write(xp, buf, BUF_SZ);
+}
+
+int xport_writev(struct xport_t* xp, const struct xport_iov_t* iov, const int cnt)
+{
+	//i.e. a frame gathered from several buffers goes out in one system call where the backend allows it
+	if(xp->ops->writev != NULL)
+	{
+		return xp->ops->writev(xp, iov, cnt);
+	}
+	int done = 0;
+	int k = 0;
+	for(k = 0; k < cnt; k++)
+	{
+		int wret = xp->ops->write(xp, iov[k].buf, iov[k].len);
+		if(wret < 0)
+		{
+			return -1;
+		}
+		done += wret;
+	}
+	return done;
+}
+
+int xport_wait(struct xport_t* xp, const uint64_t deadline_us)
+{
+	//i.e. block until readable or deadline; 0 may also mean interrupted, so callers check the clock
+	if(xp->rx_head != xp->rx_tail)
+	{
+		return 1;
+	}
+	uint64_t now = xport_now_us();
+	if(now >= deadline_us)
+	{
+		return 0;
+	}
+	return xp->ops->wait(xp, deadline_us - now);
+}
+
+unsigned int xport_caps(const struct xport_t* xp)
+{
+	return (xp != NULL)?(xp->caps):(0);
+}
+
+uint64_t xport_now_us(void)
+{
+	//i.e. monotonic clock, it is used for deadlines and throughput
+#ifdef _WIN32
+	LARGE_INTEGER freq = {0};
+	LARGE_INTEGER cnt = {0};
+	(void)QueryPerformanceFrequency(&freq);
+	(void)QueryPerformanceCounter(&cnt);
+	return (uint64_t)(cnt.QuadPart / freq.QuadPart) * 1000000ULL + (uint64_t)(cnt.QuadPart % freq.QuadPart) * 1000000ULL / (uint64_t)freq.QuadPart;
+#else
+	struct timespec ts = {0};
+	(void)clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+#endif
+}